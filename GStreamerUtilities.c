@@ -19,6 +19,7 @@
 
 #include "GStreamerUtilities.h"
 
+#include <string.h>
 #include <gst/gst.h>
 
 bool getVideoSizeAndFormatFromCaps(GstCaps* caps, IntSize* size, GstVideoFormat* format, int* pixelAspectRatioNumerator, int* pixelAspectRatioDenominator, int* stride)
@@ -50,6 +51,154 @@ GstBuffer* createGstBuffer(GstBuffer* buffer)
     return newBuffer;
 }
 
+static inline void premultiplyPixel(const guint8* source, guint8* destination)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    unsigned short alpha = source[3];
+    destination[0] = (source[0] * alpha + 128) / 255;
+    destination[1] = (source[1] * alpha + 128) / 255;
+    destination[2] = (source[2] * alpha + 128) / 255;
+    destination[3] = alpha;
+#else
+    unsigned short alpha = source[0];
+    destination[0] = alpha;
+    destination[1] = (source[1] * alpha + 128) / 255;
+    destination[2] = (source[2] * alpha + 128) / 255;
+    destination[3] = (source[3] * alpha + 128) / 255;
+#endif
+}
+
+static void premultiplyRow(const guint8* source, guint8* destination, int width)
+{
+    for (int x = 0; x < width; x++) {
+        premultiplyPixel(source, destination);
+        source += 4;
+        destination += 4;
+    }
+}
+
+// Bit position of the component at the given byte offset of a pixel
+// loaded as a native 32 bit word.
+static inline int componentShift(int offset)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    return offset * 8;
+#else
+    return (3 - offset) * 8;
+#endif
+}
+
+static inline unsigned pixelLuma(const guint8* pixel, int redShift, int greenShift, int blueShift)
+{
+    guint32 value;
+    memcpy(&value, pixel, sizeof(value));
+
+    // BT.709 luma in 8.8 fixed point.
+    return (54 * ((value >> redShift) & 0xff) + 183 * ((value >> greenShift) & 0xff) + 19 * ((value >> blueShift) & 0xff)) >> 8;
+}
+
+// Premultiplies the frame into destinationFrame when given, and gathers
+// the statistics of the resulting pixels when analysis is given. Each
+// row is premultiplied first and then analysed from the cache, so none
+// of the loops branches per pixel. The luma and tile sums are plain
+// reductions the compiler can vectorise; the histogram is a scatter,
+// which doesn't vectorise, so it gets its own loop rather than holding
+// the sums back.
+static void processVideoFrame(GstVideoFrame* sourceFrame, GstVideoFrame* destinationFrame, GstVideoFrame* previousFrame, FrameAnalysis* analysis)
+{
+    int width = GST_VIDEO_FRAME_WIDTH(sourceFrame);
+    int height = GST_VIDEO_FRAME_HEIGHT(sourceFrame);
+    int sourceStride = GST_VIDEO_FRAME_PLANE_STRIDE(sourceFrame, 0);
+    const guint8* sourceData = GST_VIDEO_FRAME_PLANE_DATA(sourceFrame, 0);
+    int destinationStride = destinationFrame ? GST_VIDEO_FRAME_PLANE_STRIDE(destinationFrame, 0) : 0;
+    guint8* destinationData = destinationFrame ? GST_VIDEO_FRAME_PLANE_DATA(destinationFrame, 0) : 0;
+
+    if (!analysis) {
+        for (int y = 0; y < height; y++)
+            premultiplyRow(sourceData + y * sourceStride, destinationData + y * destinationStride, width);
+        return;
+    }
+
+    const GstVideoInfo* info = &sourceFrame->info;
+    int redShift = componentShift(GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_R));
+    int greenShift = componentShift(GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_G));
+    int blueShift = componentShift(GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_B));
+
+    guint64 lumaSum = 0;
+    guint histogram[FRAME_ANALYSIS_HISTOGRAM_BINS];
+    memset(histogram, 0, sizeof(histogram));
+
+    // Absolute luma differences with the previous frame, summed per tile
+    // over the current row of tiles.
+    int previousStride = previousFrame ? GST_VIDEO_FRAME_PLANE_STRIDE(previousFrame, 0) : 0;
+    const guint8* previousData = previousFrame ? GST_VIDEO_FRAME_PLANE_DATA(previousFrame, 0) : 0;
+    int tileColumns = (width + FRAME_ANALYSIS_TILE_SIZE - 1) / FRAME_ANALYSIS_TILE_SIZE;
+    guint* tileSums = previousData ? g_newa(guint, tileColumns) : 0;
+    if (tileSums)
+        memset(tileSums, 0, tileColumns * sizeof(guint));
+    double difference = 0;
+
+    for (int y = 0; y < height; y++) {
+        const guint8* source = sourceData + y * sourceStride;
+        const guint8* row = source;
+        if (destinationData) {
+            guint8* destination = destinationData + y * destinationStride;
+            premultiplyRow(source, destination, width);
+            row = destination;
+        }
+
+        guint rowSum = 0;
+        for (int x = 0; x < width; x++)
+            rowSum += pixelLuma(row + x * 4, redShift, greenShift, blueShift);
+        lumaSum += rowSum;
+
+        for (int x = 0; x < width; x++)
+            histogram[pixelLuma(row + x * 4, redShift, greenShift, blueShift) * FRAME_ANALYSIS_HISTOGRAM_BINS / 256]++;
+
+        if (!tileSums)
+            continue;
+
+        // Both frames are compared as received, before premultiplication.
+        const guint8* previous = previousData + y * previousStride;
+        for (int tile = 0; tile < tileColumns; tile++) {
+            int end = MIN((tile + 1) * FRAME_ANALYSIS_TILE_SIZE, width);
+            guint tileSum = 0;
+
+            for (int x = tile * FRAME_ANALYSIS_TILE_SIZE; x < end; x++)
+                tileSum += ABS((int) pixelLuma(source + x * 4, redShift, greenShift, blueShift) - (int) pixelLuma(previous + x * 4, redShift, greenShift, blueShift));
+            tileSums[tile] += tileSum;
+        }
+
+        if ((y + 1) % FRAME_ANALYSIS_TILE_SIZE && y + 1 < height)
+            continue;
+
+        int rows = y % FRAME_ANALYSIS_TILE_SIZE + 1;
+        for (int tile = 0; tile < tileColumns; tile++) {
+            int columns = MIN((tile + 1) * FRAME_ANALYSIS_TILE_SIZE, width) - tile * FRAME_ANALYSIS_TILE_SIZE;
+            difference = MAX(difference, (double) tileSums[tile] / (rows * columns));
+            tileSums[tile] = 0;
+        }
+    }
+
+    memcpy(analysis->histogram, histogram, sizeof(histogram));
+    analysis->meanLuma = width * height ? (double) lumaSum / ((guint64) width * height) : 0;
+    analysis->difference = previousData ? difference : 255;
+}
+
+void premultiplyVideoFrame(GstVideoFrame* sourceFrame, GstVideoFrame* destinationFrame, GstVideoFrame* previousFrame, FrameAnalysis* analysis)
+{
+    // We don't use Color::premultipliedARGBFromColor() here because
+    // one function call per video pixel is just too expensive:
+    // For 720p/PAL for example this means 1280*720*25=23040000
+    // function calls per second!
+    processVideoFrame(sourceFrame, destinationFrame, previousFrame, analysis);
+}
+
+void analyzeVideoFrame(GstVideoFrame* frame, GstVideoFrame* previousFrame, FrameAnalysis* analysis)
+{
+    processVideoFrame(frame, 0, previousFrame, analysis);
+}
+
 bool initializeGStreamer(int *argc, char ***argv)
 {
     if (gst_is_initialized())
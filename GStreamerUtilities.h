@@ -27,8 +27,26 @@ typedef struct {
     int Width; int Height;
 } IntSize;
 
+#define FRAME_ANALYSIS_HISTOGRAM_BINS 16
+#define FRAME_ANALYSIS_TILE_SIZE 16
+
+// Statistics of a packed RGB frame, computed on the converted pixels.
+typedef struct {
+    double meanLuma;
+    guint histogram[FRAME_ANALYSIS_HISTOGRAM_BINS];
+    // Largest mean absolute luma difference with the previous frame over
+    // a FRAME_ANALYSIS_TILE_SIZE square tile, from 0 to 255, so a small
+    // moving region is not averaged away. 255 without a previous frame.
+    double difference;
+} FrameAnalysis;
+
 bool getVideoSizeAndFormatFromCaps(GstCaps*, IntSize*, GstVideoFormat*, int* pixelAspectRatioNumerator, int* pixelAspectRatioDenominator, int* stride);
 GstBuffer* createGstBuffer(GstBuffer*);
+// Converts an ARGB/BGRA frame to Cairo's pre-multiplied ARGB. Both frames must have the same size.
+// The analysis, if any, is gathered row by row while the converted pixels are in cache, and
+// compared with the previous source frame, if any, which must have the same size and format.
+void premultiplyVideoFrame(GstVideoFrame* source, GstVideoFrame* destination, GstVideoFrame* previous, FrameAnalysis*);
+void analyzeVideoFrame(GstVideoFrame*, GstVideoFrame* previous, FrameAnalysis*);
 bool initializeGStreamer(int *argc, char ***argv);
 
 #endif
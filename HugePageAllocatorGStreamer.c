@@ -0,0 +1,184 @@
+/*
+ *
+ * WebKitHugePageAllocator is a GstAllocator backing large memory
+ * blocks, typically whole video frames, with huge pages. This keeps
+ * the TLB footprint of a 4K frame to a handful of entries.
+ *
+ * Explicit huge pages (MAP_HUGETLB) are used when the system has
+ * some reserved, otherwise the allocator falls back to transparent
+ * huge pages through madvise(). Blocks smaller than half a huge page
+ * are served by the system memory allocator.
+ */
+
+#include "HugePageAllocatorGStreamer.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+
+#define WEBKIT_DEFAULT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+GST_DEBUG_CATEGORY_STATIC(webkitHugePageAllocatorDebug);
+#define GST_CAT_DEFAULT webkitHugePageAllocatorDebug
+
+typedef struct {
+    GstMemory memory;
+
+    // Start of the mapping, only set on the memory owning it. Shared
+    // memories point to the data of their parent.
+    gpointer mapping;
+    gsize mappingSize;
+    guint8* data;
+} WebKitHugePageMemory;
+
+#define webkit_huge_page_allocator_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE(WebKitHugePageAllocator, webkit_huge_page_allocator, GST_TYPE_ALLOCATOR, GST_DEBUG_CATEGORY_INIT(webkitHugePageAllocatorDebug, "webkithugepages", 0, "webkit huge page allocator"))
+
+static gsize readHugePageSize(void)
+{
+    FILE* file = fopen("/proc/meminfo", "r");
+    if (!file)
+        return WEBKIT_DEFAULT_HUGE_PAGE_SIZE;
+
+    gsize size = WEBKIT_DEFAULT_HUGE_PAGE_SIZE;
+    char line[128];
+    unsigned long kilobytes;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kilobytes) == 1) {
+            size = kilobytes * 1024;
+            break;
+        }
+    }
+
+    fclose(file);
+    return size;
+}
+
+// Maps size bytes, a multiple of hugePageSize, starting on a huge page
+// boundary. mmap() only aligns to the base page size, and the kernel can
+// back a range with transparent huge pages only where it covers whole
+// aligned huge pages, so a huge page more is mapped and the slack around
+// the aligned range is returned.
+static gpointer mapHugePageAligned(gsize size, gsize hugePageSize)
+{
+    gsize paddedSize = size + hugePageSize;
+    guint8* mapping = mmap(0, paddedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return MAP_FAILED;
+
+    guint8* aligned = (guint8*) (((guintptr) mapping + hugePageSize - 1) & ~((guintptr) hugePageSize - 1));
+    gsize leadingSize = aligned - mapping;
+    if (leadingSize)
+        munmap(mapping, leadingSize);
+    gsize trailingSize = paddedSize - leadingSize - size;
+    if (trailingSize)
+        munmap(aligned + size, trailingSize);
+
+    return aligned;
+}
+
+static gpointer webkitHugePageMemoryMap(GstMemory* memory, gsize maxSize, GstMapFlags flags)
+{
+    return ((WebKitHugePageMemory*) memory)->data;
+}
+
+static void webkitHugePageMemoryUnmap(GstMemory* memory)
+{
+}
+
+static GstMemory* webkitHugePageMemoryShare(GstMemory* memory, gssize offset, gssize size)
+{
+    WebKitHugePageMemory* hugePageMemory = (WebKitHugePageMemory*) memory;
+    GstMemory* parent = memory->parent ? memory->parent : memory;
+
+    if (size == -1)
+        size = memory->size - offset;
+
+    WebKitHugePageMemory* shared = g_slice_new(WebKitHugePageMemory);
+    gst_memory_init(GST_MEMORY_CAST(shared), GST_MINI_OBJECT_FLAGS(parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+        memory->allocator, parent, memory->maxsize, memory->align, memory->offset + offset, size);
+    shared->mapping = 0;
+    shared->mappingSize = 0;
+    shared->data = hugePageMemory->data;
+
+    return GST_MEMORY_CAST(shared);
+}
+
+static GstMemory* webkitHugePageAllocatorAlloc(GstAllocator* allocator, gsize size, GstAllocationParams* params)
+{
+    WebKitHugePageAllocator* hugePageAllocator = WEBKIT_HUGE_PAGE_ALLOCATOR(allocator);
+    gsize hugePageSize = hugePageAllocator->hugePageSize;
+    gsize maxSize = params->prefix + size + params->padding;
+
+    // Rounding small blocks up to a whole huge page wastes more than it saves.
+    if (maxSize < hugePageSize / 2) {
+        GstAllocator* systemAllocator = gst_allocator_find(GST_ALLOCATOR_SYSMEM);
+        GstMemory* memory = gst_allocator_alloc(systemAllocator, size, params);
+        gst_object_unref(systemAllocator);
+        return memory;
+    }
+
+    // The mapping is huge page aligned, only the prefix can break the requested alignment.
+    gsize alignmentOffset = params->prefix & params->align;
+    if (alignmentOffset)
+        alignmentOffset = (params->align + 1) - alignmentOffset;
+
+    gsize mappingSize = (alignmentOffset + maxSize + hugePageSize - 1) & ~(hugePageSize - 1);
+    gpointer mapping = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    mapping = mmap(0, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mapping == MAP_FAILED) {
+        // No huge pages reserved in /proc/sys/vm/nr_hugepages, ask for transparent ones instead.
+        mapping = mapHugePageAligned(mappingSize, hugePageSize);
+        if (mapping == MAP_FAILED) {
+            GST_WARNING_OBJECT(allocator, "Failed to map %" G_GSIZE_FORMAT " bytes", mappingSize);
+            return 0;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(mapping, mappingSize, MADV_HUGEPAGE);
+#endif
+    }
+
+    WebKitHugePageMemory* memory = g_slice_new(WebKitHugePageMemory);
+    gst_memory_init(GST_MEMORY_CAST(memory), params->flags, allocator, 0, maxSize, params->align, params->prefix, size);
+    memory->mapping = mapping;
+    memory->mappingSize = mappingSize;
+    memory->data = (guint8*) mapping + alignmentOffset;
+
+    return GST_MEMORY_CAST(memory);
+}
+
+static void webkitHugePageAllocatorFree(GstAllocator* allocator, GstMemory* memory)
+{
+    WebKitHugePageMemory* hugePageMemory = (WebKitHugePageMemory*) memory;
+
+    if (hugePageMemory->mapping)
+        munmap(hugePageMemory->mapping, hugePageMemory->mappingSize);
+
+    g_slice_free(WebKitHugePageMemory, hugePageMemory);
+}
+
+static void webkit_huge_page_allocator_init(WebKitHugePageAllocator* hugePageAllocator)
+{
+    GstAllocator* allocator = GST_ALLOCATOR_CAST(hugePageAllocator);
+
+    allocator->mem_type = WEBKIT_HUGE_PAGE_ALLOCATOR_NAME;
+    allocator->mem_map = webkitHugePageMemoryMap;
+    allocator->mem_unmap = webkitHugePageMemoryUnmap;
+    allocator->mem_share = webkitHugePageMemoryShare;
+
+    hugePageAllocator->hugePageSize = readHugePageSize();
+
+#if GST_CHECK_VERSION(1, 10, 0)
+    GST_OBJECT_FLAG_SET(allocator, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+#endif
+}
+
+static void webkit_huge_page_allocator_class_init(WebKitHugePageAllocatorClass* klass)
+{
+    GstAllocatorClass* allocatorClass = GST_ALLOCATOR_CLASS(klass);
+
+    allocatorClass->alloc = webkitHugePageAllocatorAlloc;
+    allocatorClass->free = webkitHugePageAllocatorFree;
+}
@@ -0,0 +1,28 @@
+#ifndef HugePageAllocatorGStreamer_h
+#define HugePageAllocatorGStreamer_h
+
+#include <gst/gst.h>
+
+// Name under which the allocator is registered, see gst_allocator_find().
+#define WEBKIT_HUGE_PAGE_ALLOCATOR_NAME "WebKitHugePageMemory"
+
+#define WEBKIT_TYPE_HUGE_PAGE_ALLOCATOR webkit_huge_page_allocator_get_type()
+
+#define WEBKIT_HUGE_PAGE_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), WEBKIT_TYPE_HUGE_PAGE_ALLOCATOR, WebKitHugePageAllocator))
+#define WEBKIT_IS_HUGE_PAGE_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), WEBKIT_TYPE_HUGE_PAGE_ALLOCATOR))
+
+typedef struct _WebKitHugePageAllocator WebKitHugePageAllocator;
+typedef struct _WebKitHugePageAllocatorClass WebKitHugePageAllocatorClass;
+
+struct _WebKitHugePageAllocator {
+    GstAllocator parent;
+    gsize hugePageSize;
+};
+
+struct _WebKitHugePageAllocatorClass {
+    GstAllocatorClass parent_class;
+};
+
+GType webkit_huge_page_allocator_get_type(void) G_GNUC_CONST;
+
+#endif
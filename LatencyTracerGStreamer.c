@@ -0,0 +1,627 @@
+/*
+ *
+ * WebKitLatencyTracer measures, for every buffer travelling through a
+ * pipeline:
+ *
+ *  - the processing time of each element, that is the time spent in
+ *    its chain (or getrange) function minus the time spent pushing
+ *    downstream from it,
+ *  - the time each pad takes to get a buffer accepted by its peer,
+ *  - the time buffers spend inside queues,
+ *  - the end-to-end latency, from the first time a video PTS is seen
+ *    in the pipeline until the WebKit video sink dispatched the
+ *    repaint for it.
+ *
+ * Samples are aggregated into log2 histograms attached to the elements
+ * and pads they describe, and released with them. The histograms of a
+ * pipeline are printed and reset whenever it posts EOS.
+ */
+
+#include "LatencyTracerGStreamer.h"
+
+#if GST_CHECK_VERSION(1, 8, 0)
+
+#include "VideoSinkGStreamer.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Bucket i holds samples in [2^i, 2^(i+1)) microseconds, the first one
+// everything below 2us and the last one everything above.
+#define LATENCY_BUCKETS 24
+
+// PTS seen upstream but never reaching the video sink (dropped frames,
+// other video branches) are forgotten past this many.
+#define MAX_PENDING_TIMESTAMPS 1024
+
+GST_DEBUG_CATEGORY_STATIC(webkitLatencyTracerDebug);
+#define GST_CAT_DEFAULT webkitLatencyTracerDebug
+
+typedef enum {
+    LATENCY_ELEMENT,
+    LATENCY_PAD,
+    LATENCY_QUEUE,
+    LATENCY_END_TO_END,
+    LATENCY_KIND_COUNT
+} LatencyKind;
+
+static const char* s_latencyKindNames[LATENCY_KIND_COUNT] = {
+    "element processing", "pad push", "queue residency", "end-to-end"
+};
+
+// Each histogram has its own lock, so threads only contend when they
+// process buffers in the same element or push on the same pad.
+typedef struct {
+    GMutex lock;
+    LatencyKind kind;
+    gchar* name;
+    guint64 count;
+    GstClockTime total;
+    GstClockTime max;
+    guint64 buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+// State of a top-level pipeline, shared by the elements inside it.
+typedef struct {
+    gint refCount;
+    LatencyHistogram* endToEnd;
+
+    // Protected by the lock.
+    GMutex lock;
+    GHashTable* pendingTimestamps;
+} PipelineLatency;
+
+typedef struct {
+    PipelineLatency* pipeline;
+    LatencyHistogram* processing;
+    // Only set for queues.
+    LatencyHistogram* residency;
+    bool isQueue;
+    bool isVideoSink;
+} ElementLatency;
+
+typedef struct {
+    LatencyHistogram* push;
+    // Entry timestamps of the buffers inside the queue, for queue sink
+    // pads. Protected by the lock.
+    GMutex lock;
+    GArray* queueEntries;
+    guint queueHead;
+    // Sink pad of the same queue stream, for queue source pads.
+    gpointer queueSinkPad;
+    // -1 until the pad has caps.
+    int isVideo;
+} PadLatency;
+
+typedef struct {
+    // Must stay first, the table hashes entries as gint64.
+    gint64 pts;
+    GstClockTime firstSeen;
+} PendingTimestamp;
+
+// One frame per gst_pad_push() or gst_pad_pull_range() in progress on a thread.
+typedef struct {
+    GstPad* pad;
+    GstClockTime start;
+    GstClockTime children;
+    GstClockTime pts;
+} LatencyFrame;
+
+struct _WebKitLatencyTracerPrivate {
+    // Only taken the first time an object is seen, to attach its data.
+    GMutex lock;
+};
+
+static GQuark s_pipelineLatencyQuark;
+static GQuark s_elementLatencyQuark;
+static GQuark s_padLatencyQuark;
+static GPrivate s_latencyStack = G_PRIVATE_INIT((GDestroyNotify) g_array_unref);
+
+#define webkit_latency_tracer_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE(WebKitLatencyTracer, webkit_latency_tracer, GST_TYPE_TRACER, GST_DEBUG_CATEGORY_INIT(webkitLatencyTracerDebug, "webkitlatency", 0, "webkit latency tracer"))
+
+static LatencyHistogram* latencyHistogramNew(LatencyKind kind, gchar* name)
+{
+    LatencyHistogram* histogram = g_slice_new0(LatencyHistogram);
+    g_mutex_init(&histogram->lock);
+    histogram->kind = kind;
+    histogram->name = name;
+    return histogram;
+}
+
+static void latencyHistogramFree(LatencyHistogram* histogram)
+{
+    if (!histogram)
+        return;
+
+    g_mutex_clear(&histogram->lock);
+    g_free(histogram->name);
+    g_slice_free(LatencyHistogram, histogram);
+}
+
+static void addSample(LatencyHistogram* histogram, GstClockTime duration)
+{
+    guint64 microseconds = duration / GST_USECOND;
+    guint bucket = microseconds ? g_bit_storage(microseconds) - 1 : 0;
+
+    g_mutex_lock(&histogram->lock);
+    histogram->buckets[MIN(bucket, LATENCY_BUCKETS - 1)]++;
+    histogram->count++;
+    histogram->total += duration;
+    histogram->max = MAX(histogram->max, duration);
+    g_mutex_unlock(&histogram->lock);
+}
+
+static void pendingTimestampFree(gpointer data)
+{
+    g_slice_free(PendingTimestamp, data);
+}
+
+static PipelineLatency* pipelineLatencyRef(PipelineLatency* latency)
+{
+    g_atomic_int_inc(&latency->refCount);
+    return latency;
+}
+
+static void pipelineLatencyUnref(PipelineLatency* latency)
+{
+    if (!g_atomic_int_dec_and_test(&latency->refCount))
+        return;
+
+    latencyHistogramFree(latency->endToEnd);
+    g_hash_table_unref(latency->pendingTimestamps);
+    g_mutex_clear(&latency->lock);
+    g_slice_free(PipelineLatency, latency);
+}
+
+static void elementLatencyFree(ElementLatency* latency)
+{
+    latencyHistogramFree(latency->processing);
+    latencyHistogramFree(latency->residency);
+    pipelineLatencyUnref(latency->pipeline);
+    g_slice_free(ElementLatency, latency);
+}
+
+static void padLatencyFree(PadLatency* latency)
+{
+    latencyHistogramFree(latency->push);
+    if (latency->queueEntries)
+        g_array_unref(latency->queueEntries);
+    g_mutex_clear(&latency->lock);
+    g_slice_free(PadLatency, latency);
+}
+
+static GstElement* parentElement(GstPad* pad)
+{
+    GstObject* parent = GST_OBJECT_PARENT(pad);
+
+    // Internal pads of ghost pads have the ghost pad as parent.
+    if (parent && GST_IS_PAD(parent))
+        parent = GST_OBJECT_PARENT(parent);
+
+    return parent && GST_IS_ELEMENT(parent) ? GST_ELEMENT_CAST(parent) : 0;
+}
+
+static bool isQueue(GstElement* element)
+{
+    const char* typeName = G_OBJECT_TYPE_NAME(element);
+    return g_str_equal(typeName, "GstQueue") || g_str_equal(typeName, "GstQueue2") || g_str_equal(typeName, "GstMultiQueue");
+}
+
+// Must be called with the tracer lock held.
+static PipelineLatency* getPipelineLatency(GstElement* element)
+{
+    GstObject* topLevel = GST_OBJECT(element);
+    while (GST_OBJECT_PARENT(topLevel))
+        topLevel = GST_OBJECT_PARENT(topLevel);
+
+    PipelineLatency* latency = g_object_get_qdata(G_OBJECT(topLevel), s_pipelineLatencyQuark);
+    if (latency)
+        return latency;
+
+    latency = g_slice_new0(PipelineLatency);
+    latency->refCount = 1;
+    latency->endToEnd = latencyHistogramNew(LATENCY_END_TO_END, g_strdup("source PTS to repaint"));
+    g_mutex_init(&latency->lock);
+    latency->pendingTimestamps = g_hash_table_new_full(g_int64_hash, g_int64_equal, pendingTimestampFree, 0);
+
+    g_object_set_qdata_full(G_OBJECT(topLevel), s_pipelineLatencyQuark, latency, (GDestroyNotify) pipelineLatencyUnref);
+    return latency;
+}
+
+// The data is attached to the element and released with it.
+static ElementLatency* getElementLatency(WebKitLatencyTracerPrivate* priv, GstElement* element)
+{
+    ElementLatency* latency = g_object_get_qdata(G_OBJECT(element), s_elementLatencyQuark);
+    if (G_LIKELY(latency))
+        return latency;
+
+    g_mutex_lock(&priv->lock);
+    latency = g_object_get_qdata(G_OBJECT(element), s_elementLatencyQuark);
+    if (!latency) {
+        latency = g_slice_new0(ElementLatency);
+        latency->pipeline = pipelineLatencyRef(getPipelineLatency(element));
+        latency->processing = latencyHistogramNew(LATENCY_ELEMENT, g_strdup(GST_OBJECT_NAME(element)));
+        latency->isQueue = isQueue(element);
+        if (latency->isQueue)
+            latency->residency = latencyHistogramNew(LATENCY_QUEUE, g_strdup(GST_OBJECT_NAME(element)));
+        latency->isVideoSink = WEBKIT_IS_VIDEO_SINK(element);
+
+        g_object_set_qdata_full(G_OBJECT(element), s_elementLatencyQuark, latency, (GDestroyNotify) elementLatencyFree);
+    }
+    g_mutex_unlock(&priv->lock);
+
+    return latency;
+}
+
+// The data is attached to the pad and released with it.
+static PadLatency* getPadLatency(WebKitLatencyTracerPrivate* priv, GstPad* pad)
+{
+    PadLatency* latency = g_object_get_qdata(G_OBJECT(pad), s_padLatencyQuark);
+    if (G_LIKELY(latency))
+        return latency;
+
+    g_mutex_lock(&priv->lock);
+    latency = g_object_get_qdata(G_OBJECT(pad), s_padLatencyQuark);
+    if (!latency) {
+        latency = g_slice_new0(PadLatency);
+        latency->push = latencyHistogramNew(LATENCY_PAD, g_strdup_printf("%s:%s", GST_DEBUG_PAD_NAME(pad)));
+        g_mutex_init(&latency->lock);
+        latency->isVideo = -1;
+
+        g_object_set_qdata_full(G_OBJECT(pad), s_padLatencyQuark, latency, (GDestroyNotify) padLatencyFree);
+    }
+    g_mutex_unlock(&priv->lock);
+
+    return latency;
+}
+
+// Returns the sink pad feeding a queue source pad: "sink" for queue
+// and queue2, "sink_N" for the "src_N" pads of multiqueue.
+static GstPad* queueSinkPadForSourcePad(GstElement* queue, GstPad* sourcePad)
+{
+    const char* name = GST_OBJECT_NAME(sourcePad);
+    const char* index = strchr(name, '_');
+
+    gchar* sinkPadName = index ? g_strconcat("sink", index, NULL) : g_strdup("sink");
+    GstPad* sinkPad = gst_element_get_static_pad(queue, sinkPadName);
+    g_free(sinkPadName);
+
+    // The queue keeps its pads alive as long as the pad pushing from it.
+    if (sinkPad)
+        gst_object_unref(sinkPad);
+    return sinkPad;
+}
+
+static bool padCarriesVideo(GstPad* pad)
+{
+    PadLatency* latency = g_object_get_qdata(G_OBJECT(pad), s_padLatencyQuark);
+    if (latency && latency->isVideo != -1)
+        return latency->isVideo;
+
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+        return false;
+
+    bool isVideo = gst_caps_get_size(caps) && g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/");
+    gst_caps_unref(caps);
+
+    if (latency)
+        latency->isVideo = isVideo;
+    return isVideo;
+}
+
+static void enterPad(WebKitLatencyTracer* tracer, GstClockTime timestamp, GstPad* pad, GstBuffer* buffer)
+{
+    WebKitLatencyTracerPrivate* priv = tracer->priv;
+
+    GArray* stack = g_private_get(&s_latencyStack);
+    if (!stack) {
+        stack = g_array_new(FALSE, FALSE, sizeof(LatencyFrame));
+        g_private_set(&s_latencyStack, stack);
+    }
+
+    LatencyFrame frame = { pad, timestamp, 0, buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE };
+    g_array_append_val(stack, frame);
+
+    if (!buffer)
+        return;
+
+    GstPad* peer = GST_PAD_PEER(pad);
+    GstElement* element = parentElement(pad);
+    GstElement* peerElement = peer ? parentElement(peer) : 0;
+    ElementLatency* elementLatency = element ? getElementLatency(priv, element) : 0;
+
+    // Leaving a queue.
+    if (elementLatency && elementLatency->isQueue && GST_PAD_IS_SRC(pad)) {
+        PadLatency* sourceLatency = getPadLatency(priv, pad);
+        if (!sourceLatency->queueSinkPad)
+            sourceLatency->queueSinkPad = queueSinkPadForSourcePad(element, pad);
+
+        PadLatency* sinkLatency = sourceLatency->queueSinkPad ? getPadLatency(priv, sourceLatency->queueSinkPad) : 0;
+        if (sinkLatency) {
+            GstClockTime entry = GST_CLOCK_TIME_NONE;
+
+            g_mutex_lock(&sinkLatency->lock);
+            if (sinkLatency->queueEntries && sinkLatency->queueHead < sinkLatency->queueEntries->len) {
+                entry = g_array_index(sinkLatency->queueEntries, GstClockTime, sinkLatency->queueHead++);
+                if (sinkLatency->queueHead == sinkLatency->queueEntries->len) {
+                    g_array_set_size(sinkLatency->queueEntries, 0);
+                    sinkLatency->queueHead = 0;
+                }
+            }
+            g_mutex_unlock(&sinkLatency->lock);
+
+            if (GST_CLOCK_TIME_IS_VALID(entry))
+                addSample(elementLatency->residency, timestamp - entry);
+        }
+    }
+
+    // Entering a queue.
+    if (peerElement && getElementLatency(priv, peerElement)->isQueue) {
+        PadLatency* sinkLatency = getPadLatency(priv, peer);
+        g_mutex_lock(&sinkLatency->lock);
+        if (!sinkLatency->queueEntries)
+            sinkLatency->queueEntries = g_array_new(FALSE, FALSE, sizeof(GstClockTime));
+        g_array_append_val(sinkLatency->queueEntries, timestamp);
+        g_mutex_unlock(&sinkLatency->lock);
+    }
+
+    if (elementLatency && GST_CLOCK_TIME_IS_VALID(frame.pts) && padCarriesVideo(pad)) {
+        PipelineLatency* pipeline = elementLatency->pipeline;
+
+        g_mutex_lock(&pipeline->lock);
+        if (!g_hash_table_contains(pipeline->pendingTimestamps, &frame.pts)) {
+            if (g_hash_table_size(pipeline->pendingTimestamps) >= MAX_PENDING_TIMESTAMPS)
+                g_hash_table_remove_all(pipeline->pendingTimestamps);
+
+            PendingTimestamp* pending = g_slice_new(PendingTimestamp);
+            pending->pts = frame.pts;
+            pending->firstSeen = timestamp;
+            g_hash_table_add(pipeline->pendingTimestamps, pending);
+        }
+        g_mutex_unlock(&pipeline->lock);
+    }
+}
+
+static void leavePad(WebKitLatencyTracer* tracer, GstClockTime timestamp, GstPad* pad)
+{
+    WebKitLatencyTracerPrivate* priv = tracer->priv;
+
+    GArray* stack = g_private_get(&s_latencyStack);
+    if (!stack || !stack->len)
+        return;
+
+    // Pushes started before the tracer was installed have no frame.
+    LatencyFrame frame = g_array_index(stack, LatencyFrame, stack->len - 1);
+    if (frame.pad != pad)
+        return;
+
+    g_array_set_size(stack, stack->len - 1);
+
+    GstClockTime duration = timestamp - frame.start;
+    if (stack->len)
+        g_array_index(stack, LatencyFrame, stack->len - 1).children += duration;
+
+    // For pushes the peer is the element processing the buffer, for
+    // pulls it is the element producing it.
+    GstPad* peer = GST_PAD_PEER(pad);
+    GstElement* element = peer ? parentElement(peer) : 0;
+
+    addSample(getPadLatency(priv, pad)->push, duration);
+
+    if (!element)
+        return;
+
+    ElementLatency* elementLatency = getElementLatency(priv, element);
+    addSample(elementLatency->processing, duration > frame.children ? duration - frame.children : 0);
+
+    // The video sink returns from render() once the repaint has been dispatched.
+    if (elementLatency->isVideoSink && GST_CLOCK_TIME_IS_VALID(frame.pts)) {
+        PipelineLatency* pipeline = elementLatency->pipeline;
+        GstClockTime firstSeen = GST_CLOCK_TIME_NONE;
+
+        g_mutex_lock(&pipeline->lock);
+        PendingTimestamp* pending = g_hash_table_lookup(pipeline->pendingTimestamps, &frame.pts);
+        if (pending) {
+            firstSeen = pending->firstSeen;
+            g_hash_table_remove(pipeline->pendingTimestamps, &frame.pts);
+        }
+        g_mutex_unlock(&pipeline->lock);
+
+        if (GST_CLOCK_TIME_IS_VALID(firstSeen))
+            addSample(pipeline->endToEnd, timestamp - firstSeen);
+    }
+}
+
+static void webkitLatencyTracerPushPre(GObject* object, GstClockTime timestamp, GstPad* pad, GstBuffer* buffer)
+{
+    enterPad(WEBKIT_LATENCY_TRACER(object), timestamp, pad, buffer);
+}
+
+static void webkitLatencyTracerPushListPre(GObject* object, GstClockTime timestamp, GstPad* pad, GstBufferList* list)
+{
+    enterPad(WEBKIT_LATENCY_TRACER(object), timestamp, pad, gst_buffer_list_length(list) ? gst_buffer_list_get(list, 0) : 0);
+}
+
+static void webkitLatencyTracerPullRangePre(GObject* object, GstClockTime timestamp, GstPad* pad, guint64 offset, guint size)
+{
+    enterPad(WEBKIT_LATENCY_TRACER(object), timestamp, pad, 0);
+}
+
+static void webkitLatencyTracerPushPost(GObject* object, GstClockTime timestamp, GstPad* pad, GstFlowReturn result)
+{
+    leavePad(WEBKIT_LATENCY_TRACER(object), timestamp, pad);
+}
+
+static void webkitLatencyTracerPullRangePost(GObject* object, GstClockTime timestamp, GstPad* pad, GstBuffer* buffer, GstFlowReturn result)
+{
+    leavePad(WEBKIT_LATENCY_TRACER(object), timestamp, pad);
+}
+
+static void webkitLatencyTracerPushEventPre(GObject* object, GstClockTime timestamp, GstPad* pad, GstEvent* event)
+{
+    if (GST_EVENT_TYPE(event) != GST_EVENT_FLUSH_STOP)
+        return;
+
+    // Flushed queues are emptied, and flushed frames never reach the sink.
+    GstPad* peer = GST_PAD_PEER(pad);
+    PadLatency* padLatency = peer ? g_object_get_qdata(G_OBJECT(peer), s_padLatencyQuark) : 0;
+    if (padLatency) {
+        g_mutex_lock(&padLatency->lock);
+        if (padLatency->queueEntries)
+            g_array_set_size(padLatency->queueEntries, 0);
+        padLatency->queueHead = 0;
+        g_mutex_unlock(&padLatency->lock);
+    }
+
+    GstElement* element = parentElement(pad);
+    ElementLatency* elementLatency = element ? g_object_get_qdata(G_OBJECT(element), s_elementLatencyQuark) : 0;
+    if (elementLatency) {
+        g_mutex_lock(&elementLatency->pipeline->lock);
+        g_hash_table_remove_all(elementLatency->pipeline->pendingTimestamps);
+        g_mutex_unlock(&elementLatency->pipeline->lock);
+    }
+}
+
+static double percentile(LatencyHistogram* histogram, double fraction)
+{
+    guint64 threshold = histogram->count * fraction;
+    guint64 count = 0;
+    for (guint i = 0; i < LATENCY_BUCKETS; i++) {
+        count += histogram->buckets[i];
+        if (count > threshold)
+            return (double) (G_GUINT64_CONSTANT(2) << i) / 1000;
+    }
+    return (double) histogram->max / GST_MSECOND;
+}
+
+static void collectHistograms(GPtrArray* histograms, GstElement* element)
+{
+    ElementLatency* elementLatency = g_object_get_qdata(G_OBJECT(element), s_elementLatencyQuark);
+    if (elementLatency) {
+        g_ptr_array_add(histograms, elementLatency->processing);
+        if (elementLatency->residency)
+            g_ptr_array_add(histograms, elementLatency->residency);
+    }
+
+    GST_OBJECT_LOCK(element);
+    for (GList* pads = element->pads; pads; pads = pads->next) {
+        PadLatency* padLatency = g_object_get_qdata(G_OBJECT(pads->data), s_padLatencyQuark);
+        if (padLatency)
+            g_ptr_array_add(histograms, padLatency->push);
+    }
+    GST_OBJECT_UNLOCK(element);
+}
+
+// Prints and resets the histograms of the elements and pads of the pipeline.
+static void dumpHistograms(GstElement* pipeline)
+{
+    PipelineLatency* pipelineLatency = g_object_get_qdata(G_OBJECT(pipeline), s_pipelineLatencyQuark);
+    if (!pipelineLatency)
+        return;
+
+    GPtrArray* histograms = g_ptr_array_new();
+    g_ptr_array_add(histograms, pipelineLatency->endToEnd);
+    collectHistograms(histograms, pipeline);
+
+    GstIterator* iterator = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue item = G_VALUE_INIT;
+    bool done = false;
+    while (!done) {
+        switch (gst_iterator_next(iterator, &item)) {
+        case GST_ITERATOR_OK:
+            collectHistograms(histograms, g_value_get_object(&item));
+            g_value_reset(&item);
+            break;
+        case GST_ITERATOR_RESYNC:
+            g_ptr_array_set_size(histograms, 0);
+            g_ptr_array_add(histograms, pipelineLatency->endToEnd);
+            collectHistograms(histograms, pipeline);
+            gst_iterator_resync(iterator);
+            break;
+        default:
+            done = true;
+            break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(iterator);
+
+    g_printerr("\nLatency report for %s (milliseconds; percentiles are bucket upper bounds)\n", GST_OBJECT_NAME(pipeline));
+
+    for (guint kind = 0; kind < LATENCY_KIND_COUNT; kind++) {
+        g_printerr("  %s:\n", s_latencyKindNames[kind]);
+        for (guint i = 0; i < histograms->len; i++) {
+            LatencyHistogram* histogram = g_ptr_array_index(histograms, i);
+            if (histogram->kind != kind)
+                continue;
+
+            g_mutex_lock(&histogram->lock);
+            if (histogram->count) {
+                g_printerr("    %-40s %8" G_GUINT64_FORMAT " samples, mean %8.3f, p50 < %8.3f, p99 < %8.3f, max %8.3f\n",
+                    histogram->name, histogram->count, (double) histogram->total / histogram->count / GST_MSECOND,
+                    percentile(histogram, 0.5), percentile(histogram, 0.99), (double) histogram->max / GST_MSECOND);
+
+                histogram->count = 0;
+                histogram->total = 0;
+                histogram->max = 0;
+                memset(histogram->buckets, 0, sizeof(histogram->buckets));
+            }
+            g_mutex_unlock(&histogram->lock);
+        }
+    }
+
+    g_ptr_array_unref(histograms);
+
+    g_mutex_lock(&pipelineLatency->lock);
+    g_hash_table_remove_all(pipelineLatency->pendingTimestamps);
+    g_mutex_unlock(&pipelineLatency->lock);
+}
+
+static void webkitLatencyTracerPostMessagePre(GObject* object, GstClockTime timestamp, GstElement* element, GstMessage* message)
+{
+    // Only the top-level pipeline posts EOS once all its sinks are done.
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_EOS || GST_OBJECT_PARENT(element) || !GST_IS_BIN(element))
+        return;
+
+    dumpHistograms(element);
+}
+
+static void webkit_latency_tracer_init(WebKitLatencyTracer* tracer)
+{
+    tracer->priv = G_TYPE_INSTANCE_GET_PRIVATE(tracer, WEBKIT_TYPE_LATENCY_TRACER, WebKitLatencyTracerPrivate);
+    g_mutex_init(&tracer->priv->lock);
+
+    GstTracer* gstTracer = GST_TRACER(tracer);
+    gst_tracing_register_hook(gstTracer, "pad-push-pre", G_CALLBACK(webkitLatencyTracerPushPre));
+    gst_tracing_register_hook(gstTracer, "pad-push-post", G_CALLBACK(webkitLatencyTracerPushPost));
+    gst_tracing_register_hook(gstTracer, "pad-push-list-pre", G_CALLBACK(webkitLatencyTracerPushListPre));
+    gst_tracing_register_hook(gstTracer, "pad-push-list-post", G_CALLBACK(webkitLatencyTracerPushPost));
+    gst_tracing_register_hook(gstTracer, "pad-pull-range-pre", G_CALLBACK(webkitLatencyTracerPullRangePre));
+    gst_tracing_register_hook(gstTracer, "pad-pull-range-post", G_CALLBACK(webkitLatencyTracerPullRangePost));
+    gst_tracing_register_hook(gstTracer, "pad-push-event-pre", G_CALLBACK(webkitLatencyTracerPushEventPre));
+    gst_tracing_register_hook(gstTracer, "element-post-message-pre", G_CALLBACK(webkitLatencyTracerPostMessagePre));
+}
+
+static void webkitLatencyTracerFinalize(GObject* object)
+{
+    g_mutex_clear(&WEBKIT_LATENCY_TRACER(object)->priv->lock);
+
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void webkit_latency_tracer_class_init(WebKitLatencyTracerClass* klass)
+{
+    GObjectClass* gobjectClass = G_OBJECT_CLASS(klass);
+
+    g_type_class_add_private(klass, sizeof(WebKitLatencyTracerPrivate));
+
+    gobjectClass->finalize = webkitLatencyTracerFinalize;
+
+    s_pipelineLatencyQuark = g_quark_from_static_string("webkit-latency-pipeline");
+    s_elementLatencyQuark = g_quark_from_static_string("webkit-latency-element");
+    s_padLatencyQuark = g_quark_from_static_string("webkit-latency-pad");
+}
+
+#endif
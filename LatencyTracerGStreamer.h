@@ -0,0 +1,33 @@
+#ifndef LatencyTracerGStreamer_h
+#define LatencyTracerGStreamer_h
+
+#include <gst/gst.h>
+
+#if GST_CHECK_VERSION(1, 8, 0)
+
+// Name of the tracer, enable it with GST_TRACERS=wklatency.
+#define WEBKIT_LATENCY_TRACER_NAME "wklatency"
+
+#define WEBKIT_TYPE_LATENCY_TRACER webkit_latency_tracer_get_type()
+
+#define WEBKIT_LATENCY_TRACER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), WEBKIT_TYPE_LATENCY_TRACER, WebKitLatencyTracer))
+#define WEBKIT_IS_LATENCY_TRACER(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), WEBKIT_TYPE_LATENCY_TRACER))
+
+typedef struct _WebKitLatencyTracer WebKitLatencyTracer;
+typedef struct _WebKitLatencyTracerClass WebKitLatencyTracerClass;
+typedef struct _WebKitLatencyTracerPrivate WebKitLatencyTracerPrivate;
+
+struct _WebKitLatencyTracer {
+    GstTracer parent;
+    WebKitLatencyTracerPrivate* priv;
+};
+
+struct _WebKitLatencyTracerClass {
+    GstTracerClass parent_class;
+};
+
+GType webkit_latency_tracer_get_type(void) G_GNUC_CONST;
+
+#endif
+
+#endif
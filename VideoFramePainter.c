@@ -0,0 +1,156 @@
+#include "VideoFramePainter.h"
+
+#include <string.h>
+
+// The target is split in horizontal strips, each one painted by a
+// worker thread through its own cairo surface wrapping that strip, so
+// no cairo object is ever shared between threads.
+typedef struct {
+    VideoFramePainter* painter;
+    GstVideoFrame* frame;
+    int y;
+    int height;
+} PaintTile;
+
+struct _VideoFramePainter {
+    int width;
+    int height;
+    int stride;
+    guint8* data;
+
+    unsigned tileCount;
+    PaintTile* tiles;
+    GThreadPool* pool;
+    GMutex mutex;
+    GCond condition;
+    unsigned pendingTiles;
+
+    VideoFramePainterStats stats;
+};
+
+cairo_surface_t* createCairoSurfaceForVideoFrame(GstVideoFrame* frame)
+{
+    // The video sink hands premultiplied ARGB (BGRA in memory on little
+    // endian) or xRGB buffers, which is what cairo expects.
+    cairo_format_t format = GST_VIDEO_INFO_HAS_ALPHA(&frame->info) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+
+    return cairo_image_surface_create_for_data(GST_VIDEO_FRAME_PLANE_DATA(frame, 0), format,
+        GST_VIDEO_FRAME_WIDTH(frame), GST_VIDEO_FRAME_HEIGHT(frame), GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0));
+}
+
+static void paintTile(VideoFramePainter* painter, PaintTile* tile)
+{
+    cairo_surface_t* target = cairo_image_surface_create_for_data(painter->data + tile->y * painter->stride,
+        CAIRO_FORMAT_ARGB32, painter->width, tile->height, painter->stride);
+    cairo_surface_t* source = createCairoSurfaceForVideoFrame(tile->frame);
+
+    cairo_t* cr = cairo_create(target);
+    cairo_translate(cr, 0, -tile->y);
+    cairo_scale(cr, (double) painter->width / GST_VIDEO_FRAME_WIDTH(tile->frame),
+        (double) painter->height / GST_VIDEO_FRAME_HEIGHT(tile->frame));
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    cairo_surface_destroy(source);
+    cairo_surface_destroy(target);
+}
+
+static void paintTileInThread(gpointer data, gpointer userData)
+{
+    PaintTile* tile = data;
+    VideoFramePainter* painter = tile->painter;
+
+    paintTile(painter, tile);
+
+    g_mutex_lock(&painter->mutex);
+    if (!--painter->pendingTiles)
+        g_cond_signal(&painter->condition);
+    g_mutex_unlock(&painter->mutex);
+}
+
+VideoFramePainter* videoFramePainterNew(int width, int height, unsigned tiles)
+{
+    VideoFramePainter* painter = g_new0(VideoFramePainter, 1);
+
+    painter->width = width;
+    painter->height = height;
+    painter->stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+    painter->data = g_malloc0(painter->stride * height);
+
+    painter->tileCount = CLAMP(tiles, 1, (unsigned) height);
+    painter->tiles = g_new0(PaintTile, painter->tileCount);
+    for (unsigned i = 0; i < painter->tileCount; i++) {
+        painter->tiles[i].painter = painter;
+        painter->tiles[i].y = height * i / painter->tileCount;
+        painter->tiles[i].height = height * (i + 1) / painter->tileCount - painter->tiles[i].y;
+    }
+
+    g_mutex_init(&painter->mutex);
+    g_cond_init(&painter->condition);
+    if (painter->tileCount > 1)
+        painter->pool = g_thread_pool_new(paintTileInThread, 0, painter->tileCount, TRUE, 0);
+
+    return painter;
+}
+
+void videoFramePainterFree(VideoFramePainter* painter)
+{
+    if (painter->pool)
+        g_thread_pool_free(painter->pool, FALSE, TRUE);
+
+    g_mutex_clear(&painter->mutex);
+    g_cond_clear(&painter->condition);
+    g_free(painter->tiles);
+    g_free(painter->data);
+    g_free(painter);
+}
+
+bool videoFramePainterPaint(VideoFramePainter* painter, GstBuffer* buffer, GstCaps* caps)
+{
+    // Like WebKit, the frame layout is looked up from the caps on every paint.
+    GstVideoInfo info;
+    if (!caps || !gst_video_info_from_caps(&info, caps))
+        return false;
+
+    gint64 startTime = g_get_monotonic_time();
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ))
+        return false;
+
+    for (unsigned i = 0; i < painter->tileCount; i++)
+        painter->tiles[i].frame = &frame;
+
+    if (!painter->pool)
+        paintTile(painter, &painter->tiles[0]);
+    else {
+        g_mutex_lock(&painter->mutex);
+        painter->pendingTiles = painter->tileCount;
+        for (unsigned i = 0; i < painter->tileCount; i++)
+            g_thread_pool_push(painter->pool, &painter->tiles[i], 0);
+
+        while (painter->pendingTiles)
+            g_cond_wait(&painter->condition, &painter->mutex);
+        g_mutex_unlock(&painter->mutex);
+    }
+
+    gst_video_frame_unmap(&frame);
+
+    gint64 paintTime = g_get_monotonic_time() - startTime;
+    painter->stats.frames++;
+    painter->stats.totalPaintTime += paintTime;
+    painter->stats.maxPaintTime = MAX(painter->stats.maxPaintTime, paintTime);
+    return true;
+}
+
+void videoFramePainterGetStats(VideoFramePainter* painter, VideoFramePainterStats* stats)
+{
+    *stats = painter->stats;
+}
+
+void videoFramePainterResetStats(VideoFramePainter* painter)
+{
+    memset(&painter->stats, 0, sizeof(painter->stats));
+}
@@ -0,0 +1,27 @@
+#ifndef VideoFramePainter_h
+#define VideoFramePainter_h
+
+#include <stdbool.h>
+#include <cairo.h>
+#include <gst/video/video.h>
+
+// Simulates what WebKit does with the buffers of the video sink: wrap
+// them, without copying, in a cairo image surface and composite them
+// scaled onto the page, here an offscreen surface.
+typedef struct _VideoFramePainter VideoFramePainter;
+
+typedef struct {
+    guint64 frames;
+    gint64 totalPaintTime;
+    gint64 maxPaintTime;
+} VideoFramePainterStats;
+
+VideoFramePainter* videoFramePainterNew(int width, int height, unsigned tiles);
+void videoFramePainterFree(VideoFramePainter*);
+bool videoFramePainterPaint(VideoFramePainter*, GstBuffer*, GstCaps*);
+void videoFramePainterGetStats(VideoFramePainter*, VideoFramePainterStats*);
+void videoFramePainterResetStats(VideoFramePainter*);
+
+cairo_surface_t* createCairoSurfaceForVideoFrame(GstVideoFrame*);
+
+#endif
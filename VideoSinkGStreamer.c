@@ -28,24 +28,32 @@
 #include "VideoSinkGStreamer.h"
 
 #include "GStreamerUtilities.h"
+#include "HugePageAllocatorGStreamer.h"
 #include <stdbool.h>
 #include <string.h>
 #include <gst/gst.h>
 #include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
 
-// CAIRO_FORMAT_RGB24 used to render the video buffers is little/big endian dependant.
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-#define GST_CAPS_FORMAT "{ BGRx, BGRA }"
-#else
-#define GST_CAPS_FORMAT "{ xRGB, ARGB }"
-#endif
 #if GST_CHECK_VERSION(1, 1, 0)
 #define GST_FEATURED_CAPS GST_VIDEO_CAPS_MAKE_WITH_FEATURES(GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META, "RGBA") ";"
 #else
 #define GST_FEATURED_CAPS
 #endif
 
-#define WEBKIT_VIDEO_SINK_PAD_CAPS GST_FEATURED_CAPS GST_VIDEO_CAPS_MAKE(GST_CAPS_FORMAT)
+#define WEBKIT_VIDEO_SINK_PAD_CAPS GST_FEATURED_CAPS GST_VIDEO_CAPS_MAKE(WEBKIT_VIDEO_SINK_CAPS_FORMAT)
+
+// Buffers handed to upstream are aligned to a cache line, which is also
+// wide enough for any vector load used on the pixels.
+#define WEBKIT_VIDEO_SINK_ALIGNMENT 64
+// One buffer being decoded, one waiting for the main loop and one kept
+// by GstBaseSink as the last sample.
+#define WEBKIT_VIDEO_SINK_POOL_MIN_BUFFERS 3
+#define WEBKIT_VIDEO_SINK_POOL_MAX_BUFFERS 8
+
+#define WEBKIT_VIDEO_SINK_DEFAULT_BLACK_THRESHOLD 16.0
+#define WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_THRESHOLD 0.5
+#define WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_FRAMES 25
 
 static GstStaticPadTemplate s_sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(WEBKIT_VIDEO_SINK_PAD_CAPS));
 
@@ -55,6 +63,7 @@ GST_DEBUG_CATEGORY_STATIC(webkitVideoSinkDebug);
 
 enum {
     REPAINT_REQUESTED,
+    SNAPSHOT,
     LAST_SIGNAL
 };
 
@@ -62,10 +71,21 @@ enum {
     PROP_0,
     PROP_CAPS,
     PROP_SILENT,
+    PROP_STRIDE_PADDING,
+    PROP_HUGE_PAGES,
+    PROP_RENDER_STATS,
+    PROP_ANALYZE,
+    PROP_BLACK_THRESHOLD,
+    PROP_FROZEN_THRESHOLD,
+    PROP_FROZEN_FRAMES,
 };
 
 static guint webkitVideoSinkSignals[LAST_SIGNAL] = { 0, };
 
+// Set on the premultiplied copies the first time they are handed out,
+// so buffers coming back from the pool are not counted as allocated.
+static GQuark s_pooledBufferQuark;
+
 struct _WebKitVideoSinkPrivate {
     GstBuffer* buffer;
     guint timeoutId;
@@ -75,6 +95,8 @@ struct _WebKitVideoSinkPrivate {
     GstVideoInfo info;
 
     GstCaps* currentCaps;
+    // Caps of the buffer waiting for the main loop. Protected by the buffer mutex.
+    GstCaps* bufferCaps;
 
     // If this is TRUE all processing should finish ASAP
     // This is necessary because there could be a race between
@@ -86,6 +108,66 @@ struct _WebKitVideoSinkPrivate {
     // Protected by the buffer mutex
     bool unlocked;
     bool silent;
+
+    // Extra pixels appended to each row of the buffers of the pool
+    // proposed to upstream.
+    guint stridePadding;
+
+    // Allocate frames, both the ones proposed to upstream and the
+    // premultiplied copies, with the huge page allocator.
+    bool hugePages;
+    GstAllocator* allocator;
+
+    // Pool of the premultiplied copies, and the caps it was made for.
+    // Only accessed from the streaming thread.
+    GstBufferPool* premultiplyPool;
+    GstCaps* premultiplyPoolCaps;
+    GstVideoInfo premultiplyInfo;
+
+    // Reported by the "render-stats" property and reset when the sink
+    // starts. The render time covers the work done by the streaming
+    // thread, not the wait for the main loop. Allocated buffers are the
+    // premultiplied copies the pool had to create, not recycled ones.
+    //
+    // Protected by the stats mutex, taken after the buffer mutex when
+    // both are held, so the property can be read from the repaint
+    // handler, which runs with the buffer mutex held.
+    GMutex statsMutex;
+    guint64 frames;
+    guint64 renderedFrames;
+    guint64 premultipliedFrames;
+    guint64 allocatedBuffers;
+    GstClockTime totalRenderTime;
+    GstClockTime maxRenderTime;
+
+    // Last buffer handed to the repaint handler, and its scaled down
+    // variant, built on demand by the "snapshot" action signal and
+    // dropped whenever the last buffer changes. The serial tells
+    // whether it changed while a scaled sample was being built.
+    //
+    // Protected by the object lock
+    GstBuffer* lastBuffer;
+    GstCaps* lastCaps;
+    guint64 lastBufferSerial;
+    GstSample* scaledSample;
+    guint scaledSampleMaxWidth;
+    guint scaledSampleMaxHeight;
+
+    // Frame analysis, gathered while the streaming thread converts the
+    // frame. Only accessed from the streaming thread, but for the
+    // settings.
+    bool analyze;
+    double blackThreshold;
+    double frozenThreshold;
+    guint frozenFrames;
+    // The last buffer analysed, as received, and its layout. The next
+    // frame is compared with it, and the render that follows the preroll
+    // of the same buffer is skipped rather than counted as frozen.
+    GstBuffer* analyzedBuffer;
+    GstVideoInfo analyzedInfo;
+    guint unchangedFrames;
+    bool black;
+    bool frozen;
 };
 
 static void print_buffer_metadata(WebKitVideoSink* sink, GstBuffer* buffer)
@@ -151,12 +233,28 @@ static void webkit_video_sink_init(WebKitVideoSink* sink)
 
     g_cond_init(&sink->priv->dataCondition);
     g_mutex_init(&sink->priv->bufferMutex);
+    g_mutex_init(&sink->priv->statsMutex);
 
     sink->priv->silent = TRUE;
+    sink->priv->blackThreshold = WEBKIT_VIDEO_SINK_DEFAULT_BLACK_THRESHOLD;
+    sink->priv->frozenThreshold = WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_THRESHOLD;
+    sink->priv->frozenFrames = WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_FRAMES;
 
     gst_video_info_init(&sink->priv->info);
 }
 
+// Must be called with the object lock held.
+static void webkitVideoSinkSetLastBuffer(WebKitVideoSinkPrivate* priv, GstBuffer* buffer, GstCaps* caps)
+{
+    gst_buffer_replace(&priv->lastBuffer, buffer);
+    gst_caps_replace(&priv->lastCaps, caps);
+    priv->lastBufferSerial++;
+    if (priv->scaledSample) {
+        gst_sample_unref(priv->scaledSample);
+        priv->scaledSample = 0;
+    }
+}
+
 static gboolean webkitVideoSinkTimeoutCallback(gpointer data)
 {
     WebKitVideoSink* sink = data;
@@ -174,6 +272,13 @@ static gboolean webkitVideoSinkTimeoutCallback(gpointer data)
     }
 
     g_signal_emit(sink, webkitVideoSinkSignals[REPAINT_REQUESTED], 0, buffer);
+    g_mutex_lock(&priv->statsMutex);
+    priv->renderedFrames++;
+    g_mutex_unlock(&priv->statsMutex);
+
+    GST_OBJECT_LOCK(sink);
+    webkitVideoSinkSetLastBuffer(priv, buffer, priv->bufferCaps);
+    GST_OBJECT_UNLOCK(sink);
     gst_buffer_unref(buffer);
     g_cond_signal(&priv->dataCondition);
     g_mutex_unlock(&priv->bufferMutex);
@@ -181,10 +286,178 @@ static gboolean webkitVideoSinkTimeoutCallback(gpointer data)
     return FALSE;
 }
 
+static void webkitVideoSinkGetAllocationParams(GstAllocationParams* params)
+{
+    gst_allocation_params_init(params);
+    params->align = WEBKIT_VIDEO_SINK_ALIGNMENT - 1;
+}
+
+static GstBufferPool* webkitVideoSinkCreatePool(WebKitVideoSink* sink, GstCaps* caps, const GstVideoInfo* videoInfo, guint padding, guint maxBuffers, guint* size)
+{
+    WebKitVideoSinkPrivate* priv = sink->priv;
+
+    // Every row starts on an aligned address, so the premultiply loop can
+    // process whole rows with aligned loads, padding included.
+    GstVideoAlignment alignment;
+    gst_video_alignment_reset(&alignment);
+    alignment.padding_right = padding;
+    for (guint i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+        alignment.stride_align[i] = WEBKIT_VIDEO_SINK_ALIGNMENT - 1;
+
+    GstVideoInfo info = *videoInfo;
+    gst_video_info_align(&info, &alignment);
+    *size = GST_VIDEO_INFO_SIZE(&info);
+
+    GstAllocationParams params;
+    webkitVideoSinkGetAllocationParams(&params);
+
+    GstBufferPool* pool = gst_video_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, *size, WEBKIT_VIDEO_SINK_POOL_MIN_BUFFERS, maxBuffers);
+    gst_buffer_pool_config_set_allocator(config, priv->allocator, &params);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+    gst_buffer_pool_config_set_video_alignment(config, &alignment);
+
+    if (!gst_buffer_pool_set_config(pool, config)) {
+        GST_WARNING_OBJECT(sink, "Failed to configure the buffer pool for caps %" GST_PTR_FORMAT, caps);
+        gst_object_unref(pool);
+        return 0;
+    }
+
+    return pool;
+}
+
+static void webkitVideoSinkClearPremultiplyPool(WebKitVideoSinkPrivate* priv)
+{
+    if (!priv->premultiplyPool)
+        return;
+
+    // Buffers still in use are freed once released to the inactive pool.
+    gst_buffer_pool_set_active(priv->premultiplyPool, FALSE);
+    gst_object_unref(priv->premultiplyPool);
+    priv->premultiplyPool = 0;
+    gst_caps_replace(&priv->premultiplyPoolCaps, 0);
+}
+
+// The premultiplied copies come from a pool of their own, so their
+// memory, huge pages included, is mapped once and then recycled. The
+// pool is unbounded: the application may hold frames as long as it
+// wants without stalling the streaming thread.
+static GstBufferPool* webkitVideoSinkGetPremultiplyPool(WebKitVideoSink* sink, GstCaps* caps)
+{
+    WebKitVideoSinkPrivate* priv = sink->priv;
+
+    if (!caps)
+        return 0;
+
+    if (priv->premultiplyPool && gst_caps_is_equal(priv->premultiplyPoolCaps, caps))
+        return priv->premultiplyPool;
+
+    webkitVideoSinkClearPremultiplyPool(priv);
+
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps))
+        return 0;
+
+    guint size;
+    GstBufferPool* pool = webkitVideoSinkCreatePool(sink, caps, &info, 0, 0, &size);
+    if (!pool)
+        return 0;
+
+    if (!gst_buffer_pool_set_active(pool, TRUE)) {
+        GST_WARNING_OBJECT(sink, "Failed to activate the premultiply buffer pool");
+        gst_object_unref(pool);
+        return 0;
+    }
+
+    priv->premultiplyPool = pool;
+    priv->premultiplyPoolCaps = gst_caps_ref(caps);
+    priv->premultiplyInfo = info;
+    return pool;
+}
+
+static bool webkitVideoSinkCanAnalyze(GstVideoFormat format)
+{
+    switch (format) {
+    case GST_VIDEO_FORMAT_BGRx:
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_xRGB:
+    case GST_VIDEO_FORMAT_ARGB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Forgets the previous frame, the next one has nothing to be compared with.
+static void webkitVideoSinkResetAnalysis(WebKitVideoSinkPrivate* priv)
+{
+    gst_buffer_replace(&priv->analyzedBuffer, 0);
+    priv->unchangedFrames = 0;
+}
+
+// Maps the frame analysed before the current one, if it has the same layout.
+static GstVideoFrame* webkitVideoSinkMapPreviousFrame(WebKitVideoSinkPrivate* priv, const GstVideoInfo* info, GstVideoFrame* frame)
+{
+    if (!priv->analyzedBuffer
+        || GST_VIDEO_INFO_FORMAT(&priv->analyzedInfo) != GST_VIDEO_INFO_FORMAT(info)
+        || GST_VIDEO_INFO_WIDTH(&priv->analyzedInfo) != GST_VIDEO_INFO_WIDTH(info)
+        || GST_VIDEO_INFO_HEIGHT(&priv->analyzedInfo) != GST_VIDEO_INFO_HEIGHT(info))
+        return 0;
+
+    return gst_video_frame_map(frame, &priv->analyzedInfo, priv->analyzedBuffer, GST_MAP_READ) ? frame : 0;
+}
+
+// Updates the black and frozen states from the analysis and returns a
+// message for the application when the frame became, or stopped being,
+// black or frozen.
+static GstMessage* webkitVideoSinkProcessAnalysis(WebKitVideoSink* sink, GstBuffer* buffer, FrameAnalysis* analysis)
+{
+    WebKitVideoSinkPrivate* priv = sink->priv;
+
+    double difference = analysis->difference;
+    if (difference <= priv->frozenThreshold)
+        priv->unchangedFrames++;
+    else
+        priv->unchangedFrames = 0;
+
+    bool black = analysis->meanLuma <= priv->blackThreshold;
+    bool frozen = priv->unchangedFrames >= priv->frozenFrames;
+    if (black == priv->black && frozen == priv->frozen)
+        return 0;
+
+    priv->black = black;
+    priv->frozen = frozen;
+
+    GValue histogram = G_VALUE_INIT;
+    g_value_init(&histogram, GST_TYPE_ARRAY);
+    for (int i = 0; i < FRAME_ANALYSIS_HISTOGRAM_BINS; i++) {
+        GValue bin = G_VALUE_INIT;
+        g_value_init(&bin, G_TYPE_UINT);
+        g_value_set_uint(&bin, analysis->histogram[i]);
+        gst_value_array_append_value(&histogram, &bin);
+        g_value_unset(&bin);
+    }
+
+    GstStructure* structure = gst_structure_new("webkit-video-analysis",
+        "timestamp", G_TYPE_UINT64, GST_BUFFER_PTS(buffer),
+        "black", G_TYPE_BOOLEAN, black,
+        "frozen", G_TYPE_BOOLEAN, frozen,
+        "mean-luma", G_TYPE_DOUBLE, analysis->meanLuma,
+        "difference", G_TYPE_DOUBLE, difference,
+        NULL);
+    gst_structure_take_value(structure, "histogram", &histogram);
+
+    GST_DEBUG_OBJECT(sink, "Frame analysis changed: %" GST_PTR_FORMAT, structure);
+    return gst_message_new_element(GST_OBJECT(sink), structure);
+}
+
 static GstFlowReturn webkitVideoSinkRender(GstBaseSink* baseSink, GstBuffer* buffer)
 {
     WebKitVideoSink* sink = WEBKIT_VIDEO_SINK(baseSink);
     WebKitVideoSinkPrivate* priv = sink->priv;
+    GstClockTime renderStartTime = gst_util_get_timestamp();
 
     g_mutex_lock(&priv->bufferMutex);
 
@@ -195,24 +468,27 @@ static GstFlowReturn webkitVideoSinkRender(GstBaseSink* baseSink, GstBuffer* buf
 
     priv->buffer = gst_buffer_ref(buffer);
 
-    GstCaps* caps;
+    GstVideoInfo info;
     // The video info structure is valid only if the sink handled an allocation query.
     if (GST_VIDEO_INFO_FORMAT(&priv->info) != GST_VIDEO_FORMAT_UNKNOWN)
-        caps = gst_video_info_to_caps(&priv->info);
-    else
-        caps = priv->currentCaps;
-
-    GstVideoFormat format;
-    IntSize size;
-    int pixelAspectRatioNumerator, pixelAspectRatioDenominator, stride;
-    if (!getVideoSizeAndFormatFromCaps(caps, &size, &format, &pixelAspectRatioNumerator, &pixelAspectRatioDenominator, &stride)) {
-        gst_caps_unref(caps);
-        gst_buffer_unref(buffer);
+        info = priv->info;
+    else if (!priv->currentCaps || !gst_video_info_from_caps(&info, priv->currentCaps)) {
+        gst_buffer_unref(priv->buffer);
+        priv->buffer = 0;
         g_mutex_unlock(&priv->bufferMutex);
         return GST_FLOW_ERROR;
     }
 
-    gst_caps_unref(caps);
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&info);
+
+    bool premultiplied = false;
+    bool allocated = false;
+
+    FrameAnalysis analysis;
+    FrameAnalysis* frameAnalysis = 0;
+    GstBuffer* inputBuffer = buffer;
+    if (priv->analyze && webkitVideoSinkCanAnalyze(format) && buffer != priv->analyzedBuffer)
+        frameAnalysis = &analysis;
 
     // Cairo's ARGB has pre-multiplied alpha while GStreamer's doesn't.
     // Here we convert to Cairo's ARGB.
@@ -222,51 +498,80 @@ static GstFlowReturn webkitVideoSinkRender(GstBaseSink* baseSink, GstBuffer* buf
         // The buffer content should not be changed here because the same buffer
         // could be passed multiple times to this method (in theory).
 
-        GstBuffer* newBuffer = createGstBuffer(buffer);
+        GstBufferPool* pool = webkitVideoSinkGetPremultiplyPool(sink, priv->currentCaps);
+        GstBuffer* newBuffer = 0;
+        if (pool && gst_buffer_pool_acquire_buffer(pool, &newBuffer, 0) != GST_FLOW_OK)
+            newBuffer = 0;
 
         // Check if allocation failed.
         if (G_UNLIKELY(!newBuffer)) {
+            gst_buffer_unref(priv->buffer);
+            priv->buffer = 0;
             g_mutex_unlock(&priv->bufferMutex);
             return GST_FLOW_ERROR;
         }
 
-        // We don't use Color::premultipliedARGBFromColor() here because
-        // one function call per video pixel is just too expensive:
-        // For 720p/PAL for example this means 1280*720*25=23040000
-        // function calls per second!
-        GstMapInfo sourceInfo;
-        GstMapInfo destinationInfo;
-        gst_buffer_map(buffer, &sourceInfo, GST_MAP_READ);
-        const guint8* source = sourceInfo.data;
-        gst_buffer_map(newBuffer, &destinationInfo, GST_MAP_WRITE);
-        guint8* destination = destinationInfo.data;
-
-        for (int x = 0; x < size.Height; x++) {
-            for (int y = 0; y < size.Width; y++) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-                unsigned short alpha = source[3];
-                destination[0] = (source[0] * alpha + 128) / 255;
-                destination[1] = (source[1] * alpha + 128) / 255;
-                destination[2] = (source[2] * alpha + 128) / 255;
-                destination[3] = alpha;
-#else
-                unsigned short alpha = source[0];
-                destination[0] = alpha;
-                destination[1] = (source[1] * alpha + 128) / 255;
-                destination[2] = (source[2] * alpha + 128) / 255;
-                destination[3] = (source[3] * alpha + 128) / 255;
-#endif
-                source += 4;
-                destination += 4;
-            }
+        if (!gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(newBuffer), s_pooledBufferQuark)) {
+            gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(newBuffer), s_pooledBufferQuark, GINT_TO_POINTER(TRUE), 0);
+            allocated = true;
         }
 
-        gst_buffer_unmap(buffer, &sourceInfo);
-        gst_buffer_unmap(newBuffer, &destinationInfo);
+        // The video meta of the source buffer is not copied, the new
+        // buffer has the layout of the pool, described by its own meta.
+        gst_buffer_copy_into(newBuffer, buffer, GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+        GstVideoFrame sourceFrame;
+        GstVideoFrame destinationFrame;
+        if (!gst_video_frame_map(&sourceFrame, &info, buffer, GST_MAP_READ)) {
+            gst_buffer_unref(newBuffer);
+            gst_buffer_unref(priv->buffer);
+            priv->buffer = 0;
+            g_mutex_unlock(&priv->bufferMutex);
+            return GST_FLOW_ERROR;
+        }
+        if (!gst_video_frame_map(&destinationFrame, &priv->premultiplyInfo, newBuffer, GST_MAP_WRITE)) {
+            gst_video_frame_unmap(&sourceFrame);
+            gst_buffer_unref(newBuffer);
+            gst_buffer_unref(priv->buffer);
+            priv->buffer = 0;
+            g_mutex_unlock(&priv->bufferMutex);
+            return GST_FLOW_ERROR;
+        }
+
+        GstVideoFrame previousFrame;
+        GstVideoFrame* previous = frameAnalysis ? webkitVideoSinkMapPreviousFrame(priv, &info, &previousFrame) : 0;
+        premultiplyVideoFrame(&sourceFrame, &destinationFrame, previous, frameAnalysis);
+        if (previous)
+            gst_video_frame_unmap(previous);
+
+        gst_video_frame_unmap(&sourceFrame);
+        gst_video_frame_unmap(&destinationFrame);
         gst_buffer_unref(buffer);
         buffer = priv->buffer = newBuffer;
+        premultiplied = true;
+    } else if (frameAnalysis) {
+        // Nothing to convert, the pixels are read once for the analysis.
+        GstVideoFrame frame;
+        if (gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ)) {
+            GstVideoFrame previousFrame;
+            GstVideoFrame* previous = webkitVideoSinkMapPreviousFrame(priv, &info, &previousFrame);
+            analyzeVideoFrame(&frame, previous, frameAnalysis);
+            if (previous)
+                gst_video_frame_unmap(previous);
+            gst_video_frame_unmap(&frame);
+        } else
+            frameAnalysis = 0;
+    }
+
+    if (frameAnalysis) {
+        gst_buffer_replace(&priv->analyzedBuffer, inputBuffer);
+        priv->analyzedInfo = info;
     }
 
+    GstMessage* analysisMessage = frameAnalysis ? webkitVideoSinkProcessAnalysis(sink, buffer, frameAnalysis) : 0;
+
+    gst_caps_replace(&priv->bufferCaps, priv->currentCaps);
+
     // This should likely use a lower priority, but glib currently starves
     // lower priority sources.
     // See: https://bugzilla.gnome.org/show_bug.cgi?id=610830.
@@ -277,8 +582,23 @@ static GstFlowReturn webkitVideoSinkRender(GstBaseSink* baseSink, GstBuffer* buf
     if (!priv->silent)
         print_buffer_metadata(sink, buffer);
 
+    GstClockTime renderTime = gst_util_get_timestamp() - renderStartTime;
+    g_mutex_lock(&priv->statsMutex);
+    priv->frames++;
+    priv->premultipliedFrames += premultiplied;
+    priv->allocatedBuffers += allocated;
+    priv->totalRenderTime += renderTime;
+    priv->maxRenderTime = MAX(priv->maxRenderTime, renderTime);
+    g_mutex_unlock(&priv->statsMutex);
+
     g_cond_wait(&priv->dataCondition, &priv->bufferMutex);
     g_mutex_unlock(&priv->bufferMutex);
+
+    // Posted once the buffer mutex is released, synchronous bus handlers
+    // might call back into the sink.
+    if (analysisMessage)
+        gst_element_post_message(GST_ELEMENT(sink), analysisMessage);
+
     return GST_FLOW_OK;
 }
 
@@ -289,6 +609,7 @@ static void webkitVideoSinkDispose(GObject* object)
 
     g_cond_clear(&priv->dataCondition);
     g_mutex_clear(&priv->bufferMutex);
+    g_mutex_clear(&priv->statsMutex);
 
     G_OBJECT_CLASS(parent_class)->dispose(object);
 }
@@ -309,6 +630,38 @@ static void webkitVideoSinkGetProperty(GObject* object, guint propertyId, GValue
     case PROP_SILENT:
         g_value_set_boolean(value, priv->silent);
         break;
+    case PROP_STRIDE_PADDING:
+        g_value_set_uint(value, priv->stridePadding);
+        break;
+    case PROP_HUGE_PAGES:
+        g_value_set_boolean(value, priv->hugePages);
+        break;
+    case PROP_RENDER_STATS: {
+        g_mutex_lock(&priv->statsMutex);
+        GstStructure* stats = gst_structure_new("webkit-video-sink-stats",
+            "frames", G_TYPE_UINT64, priv->frames,
+            "rendered", G_TYPE_UINT64, priv->renderedFrames,
+            "premultiplied", G_TYPE_UINT64, priv->premultipliedFrames,
+            "allocated", G_TYPE_UINT64, priv->allocatedBuffers,
+            "total-render-time", G_TYPE_UINT64, priv->totalRenderTime,
+            "max-render-time", G_TYPE_UINT64, priv->maxRenderTime,
+            NULL);
+        g_mutex_unlock(&priv->statsMutex);
+        g_value_take_boxed(value, stats);
+        break;
+    }
+    case PROP_ANALYZE:
+        g_value_set_boolean(value, priv->analyze);
+        break;
+    case PROP_BLACK_THRESHOLD:
+        g_value_set_double(value, priv->blackThreshold);
+        break;
+    case PROP_FROZEN_THRESHOLD:
+        g_value_set_double(value, priv->frozenThreshold);
+        break;
+    case PROP_FROZEN_FRAMES:
+        g_value_set_uint(value, priv->frozenFrames);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, parameterSpec);
     }
@@ -323,6 +676,24 @@ static void webkitVideoSinkSetProperty(GObject* object, guint propertyId, const
     case PROP_SILENT:
         priv->silent = g_value_get_boolean(value);
         break;
+    case PROP_STRIDE_PADDING:
+        priv->stridePadding = g_value_get_uint(value);
+        break;
+    case PROP_HUGE_PAGES:
+        priv->hugePages = g_value_get_boolean(value);
+        break;
+    case PROP_ANALYZE:
+        priv->analyze = g_value_get_boolean(value);
+        break;
+    case PROP_BLACK_THRESHOLD:
+        priv->blackThreshold = g_value_get_double(value);
+        break;
+    case PROP_FROZEN_THRESHOLD:
+        priv->frozenThreshold = g_value_get_double(value);
+        break;
+    case PROP_FROZEN_FRAMES:
+        priv->frozenFrames = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, parameterSpec);
     }
@@ -363,6 +734,16 @@ static gboolean webkitVideoSinkUnlockStop(GstBaseSink* baseSink)
     return GST_CALL_PARENT_WITH_DEFAULT(GST_BASE_SINK_CLASS, unlock_stop, (baseSink), TRUE);
 }
 
+static gboolean webkitVideoSinkEvent(GstBaseSink* baseSink, GstEvent* event)
+{
+    // Serialized with render by the stream lock. The first frame after a
+    // seek is not compared with the one shown before it.
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+        webkitVideoSinkResetAnalysis(WEBKIT_VIDEO_SINK(baseSink)->priv);
+
+    return GST_BASE_SINK_CLASS(parent_class)->event(baseSink, event);
+}
+
 static gboolean webkitVideoSinkStop(GstBaseSink* baseSink)
 {
     WebKitVideoSinkPrivate* priv = WEBKIT_VIDEO_SINK(baseSink)->priv;
@@ -374,6 +755,22 @@ static gboolean webkitVideoSinkStop(GstBaseSink* baseSink)
         priv->currentCaps = 0;
     }
 
+    webkitVideoSinkClearPremultiplyPool(priv);
+    webkitVideoSinkResetAnalysis(priv);
+
+    if (priv->allocator) {
+        gst_object_unref(priv->allocator);
+        priv->allocator = 0;
+    }
+
+    g_mutex_lock(&priv->bufferMutex);
+    gst_caps_replace(&priv->bufferCaps, 0);
+    g_mutex_unlock(&priv->bufferMutex);
+
+    GST_OBJECT_LOCK(baseSink);
+    webkitVideoSinkSetLastBuffer(priv, 0, 0);
+    GST_OBJECT_UNLOCK(baseSink);
+
     return TRUE;
 }
 
@@ -384,6 +781,26 @@ static gboolean webkitVideoSinkStart(GstBaseSink* baseSink)
     g_mutex_lock(&priv->bufferMutex);
     priv->unlocked = false;
     g_mutex_unlock(&priv->bufferMutex);
+
+    g_mutex_lock(&priv->statsMutex);
+    priv->frames = 0;
+    priv->renderedFrames = 0;
+    priv->premultipliedFrames = 0;
+    priv->allocatedBuffers = 0;
+    priv->totalRenderTime = 0;
+    priv->maxRenderTime = 0;
+    g_mutex_unlock(&priv->statsMutex);
+
+    webkitVideoSinkResetAnalysis(priv);
+    priv->black = false;
+    priv->frozen = false;
+
+    if (priv->hugePages) {
+        priv->allocator = gst_allocator_find(WEBKIT_HUGE_PAGE_ALLOCATOR_NAME);
+        if (!priv->allocator)
+            GST_WARNING_OBJECT(baseSink, "Huge page allocator not registered, using system memory");
+    }
+
     return TRUE;
 }
 
@@ -400,6 +817,12 @@ static gboolean webkitVideoSinkSetCaps(GstBaseSink* baseSink, GstCaps* caps)
         return FALSE;
     }
 
+    // The layout proposed to upstream only describes the caps it was
+    // proposed for, render falls back to the new caps until the next
+    // allocation query.
+    if (!priv->currentCaps || !gst_caps_is_equal(priv->currentCaps, caps))
+        gst_video_info_init(&priv->info);
+
     gst_caps_replace(&priv->currentCaps, caps);
     return TRUE;
 }
@@ -407,7 +830,8 @@ static gboolean webkitVideoSinkSetCaps(GstBaseSink* baseSink, GstCaps* caps)
 static gboolean webkitVideoSinkProposeAllocation(GstBaseSink* baseSink, GstQuery* query)
 {
     GstCaps* caps;
-    gst_query_parse_allocation(query, &caps, 0);
+    gboolean needPool;
+    gst_query_parse_allocation(query, &caps, &needPool);
     if (!caps)
         return FALSE;
 
@@ -415,6 +839,26 @@ static gboolean webkitVideoSinkProposeAllocation(GstBaseSink* baseSink, GstQuery
     if (!gst_video_info_from_caps(&sink->priv->info, caps))
         return FALSE;
 
+#if GST_CHECK_VERSION(1, 1, 0)
+    // Buffers negotiated for GL texture upload are not mapped by the sink.
+    GstCapsFeatures* features = gst_caps_get_features(caps, 0);
+    if (features && gst_caps_features_contains(features, GST_CAPS_FEATURE_META_GST_VIDEO_GL_TEXTURE_UPLOAD_META))
+        needPool = FALSE;
+#endif
+
+    if (needPool) {
+        guint size;
+        GstBufferPool* pool = webkitVideoSinkCreatePool(sink, caps, &sink->priv->info, sink->priv->stridePadding, WEBKIT_VIDEO_SINK_POOL_MAX_BUFFERS, &size);
+        if (pool) {
+            gst_query_add_allocation_pool(query, pool, size, WEBKIT_VIDEO_SINK_POOL_MIN_BUFFERS, WEBKIT_VIDEO_SINK_POOL_MAX_BUFFERS);
+            gst_object_unref(pool);
+        }
+    }
+
+    GstAllocationParams params;
+    webkitVideoSinkGetAllocationParams(&params);
+    gst_query_add_allocation_param(query, sink->priv->allocator, &params);
+
     gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, 0);
     gst_query_add_allocation_meta(query, GST_VIDEO_CROP_META_API_TYPE, 0);
 #if GST_CHECK_VERSION(1, 1, 0)
@@ -423,6 +867,132 @@ static gboolean webkitVideoSinkProposeAllocation(GstBaseSink* baseSink, GstQuery
     return TRUE;
 }
 
+// Box filter, only meant to shrink frames of 4 bytes per pixel. The
+// averaging is correct for premultiplied alpha.
+static GstBuffer* createScaledDownGstBuffer(GstVideoFrame* frame, int width, int height)
+{
+    int sourceWidth = GST_VIDEO_FRAME_WIDTH(frame);
+    int sourceHeight = GST_VIDEO_FRAME_HEIGHT(frame);
+    int sourceStride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+    const guint8* sourceData = GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+
+    GstBuffer* buffer = gst_buffer_new_allocate(0, width * height * 4, 0);
+    if (!buffer)
+        return 0;
+
+    GstMapInfo mapInfo;
+    gst_buffer_map(buffer, &mapInfo, GST_MAP_WRITE);
+    guint8* destination = mapInfo.data;
+
+    for (int y = 0; y < height; y++) {
+        int top = y * sourceHeight / height;
+        int bottom = MAX((y + 1) * sourceHeight / height, top + 1);
+        for (int x = 0; x < width; x++) {
+            int left = x * sourceWidth / width;
+            int right = MAX((x + 1) * sourceWidth / width, left + 1);
+            guint sum[4] = { 0, 0, 0, 0 };
+
+            for (int sourceY = top; sourceY < bottom; sourceY++) {
+                const guint8* source = sourceData + sourceY * sourceStride + left * 4;
+                for (int sourceX = left; sourceX < right; sourceX++) {
+                    sum[0] += source[0];
+                    sum[1] += source[1];
+                    sum[2] += source[2];
+                    sum[3] += source[3];
+                    source += 4;
+                }
+            }
+
+            guint count = (bottom - top) * (right - left);
+            for (int i = 0; i < 4; i++)
+                destination[i] = sum[i] / count;
+            destination += 4;
+        }
+    }
+
+    gst_buffer_unmap(buffer, &mapInfo);
+    gst_buffer_copy_into(buffer, frame->buffer, GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    return buffer;
+}
+
+static GstSample* webkitVideoSinkCreateScaledSample(WebKitVideoSink* sink, GstBuffer* buffer, GstCaps* caps, guint maxWidth, guint maxHeight)
+{
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps) || GST_VIDEO_INFO_COMP_PSTRIDE(&info, 0) != 4)
+        return 0;
+
+    int width = GST_VIDEO_INFO_WIDTH(&info);
+    int height = GST_VIDEO_INFO_HEIGHT(&info);
+    double scale = MIN(1.0, MIN(maxWidth ? (double) maxWidth / width : 1.0, maxHeight ? (double) maxHeight / height : 1.0));
+    int scaledWidth = MAX(1, (int) (width * scale));
+    int scaledHeight = MAX(1, (int) (height * scale));
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ)) {
+        GST_WARNING_OBJECT(sink, "Failed to map the last buffer");
+        return 0;
+    }
+
+    GstBuffer* scaledBuffer = createScaledDownGstBuffer(&frame, scaledWidth, scaledHeight);
+    gst_video_frame_unmap(&frame);
+    if (!scaledBuffer)
+        return 0;
+
+    GstCaps* scaledCaps = gst_caps_copy(caps);
+    gst_caps_set_simple(scaledCaps, "width", G_TYPE_INT, scaledWidth, "height", G_TYPE_INT, scaledHeight, NULL);
+
+    GstSample* sample = gst_sample_new(scaledBuffer, scaledCaps, 0, 0);
+    gst_buffer_unref(scaledBuffer);
+    gst_caps_unref(scaledCaps);
+    return sample;
+}
+
+static GstSample* webkitVideoSinkSnapshot(WebKitVideoSink* sink, guint maxWidth, guint maxHeight)
+{
+    WebKitVideoSinkPrivate* priv = sink->priv;
+
+    GST_OBJECT_LOCK(sink);
+    if (!priv->lastBuffer || !priv->lastCaps) {
+        GST_OBJECT_UNLOCK(sink);
+        return 0;
+    }
+
+    GstBuffer* buffer = gst_buffer_ref(priv->lastBuffer);
+    GstCaps* caps = gst_caps_ref(priv->lastCaps);
+    guint64 serial = priv->lastBufferSerial;
+    GstSample* sample = 0;
+
+    gint width = 0, height = 0;
+    GstStructure* structure = gst_caps_get_structure(caps, 0);
+    gst_structure_get_int(structure, "width", &width);
+    gst_structure_get_int(structure, "height", &height);
+
+    if ((!maxWidth || (guint) width <= maxWidth) && (!maxHeight || (guint) height <= maxHeight))
+        sample = gst_sample_new(buffer, caps, 0, 0);
+    else if (priv->scaledSample && priv->scaledSampleMaxWidth == maxWidth && priv->scaledSampleMaxHeight == maxHeight)
+        sample = gst_sample_ref(priv->scaledSample);
+    GST_OBJECT_UNLOCK(sink);
+
+    if (!sample) {
+        sample = webkitVideoSinkCreateScaledSample(sink, buffer, caps, maxWidth, maxHeight);
+        if (sample) {
+            GST_OBJECT_LOCK(sink);
+            if (priv->lastBufferSerial == serial) {
+                if (priv->scaledSample)
+                    gst_sample_unref(priv->scaledSample);
+                priv->scaledSample = gst_sample_ref(sample);
+                priv->scaledSampleMaxWidth = maxWidth;
+                priv->scaledSampleMaxHeight = maxHeight;
+            }
+            GST_OBJECT_UNLOCK(sink);
+        }
+    }
+
+    gst_buffer_unref(buffer);
+    gst_caps_unref(caps);
+    return sample;
+}
+
 static void webkit_video_sink_class_init(WebKitVideoSinkClass* klass)
 {
     GObjectClass* gobjectClass = G_OBJECT_CLASS(klass);
@@ -438,6 +1008,10 @@ static void webkit_video_sink_class_init(WebKitVideoSinkClass* klass)
     gobjectClass->get_property = webkitVideoSinkGetProperty;
     gobjectClass->set_property = webkitVideoSinkSetProperty;
 
+    klass->snapshot = webkitVideoSinkSnapshot;
+
+    s_pooledBufferQuark = g_quark_from_static_string("webkit-video-sink-pooled");
+
     baseSinkClass->unlock = webkitVideoSinkUnlock;
     baseSinkClass->unlock_stop = webkitVideoSinkUnlockStop;
     baseSinkClass->render = webkitVideoSinkRender;
@@ -445,6 +1019,7 @@ static void webkit_video_sink_class_init(WebKitVideoSinkClass* klass)
     baseSinkClass->stop = webkitVideoSinkStop;
     baseSinkClass->start = webkitVideoSinkStart;
     baseSinkClass->set_caps = webkitVideoSinkSetCaps;
+    baseSinkClass->event = webkitVideoSinkEvent;
     baseSinkClass->propose_allocation = webkitVideoSinkProposeAllocation;
 
     g_object_class_install_property(gobjectClass, PROP_CAPS,
@@ -453,6 +1028,34 @@ static void webkit_video_sink_class_init(WebKitVideoSinkClass* klass)
     g_object_class_install_property(gobjectClass, PROP_SILENT,
         g_param_spec_boolean("silent", "Silent", "Silent", TRUE, G_PARAM_READWRITE));
 
+    g_object_class_install_property(gobjectClass, PROP_STRIDE_PADDING,
+        g_param_spec_uint("stride-padding", "Stride padding", "Extra pixels appended to each row of the buffers proposed to upstream",
+            0, G_MAXUINT16, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property(gobjectClass, PROP_HUGE_PAGES,
+        g_param_spec_boolean("huge-pages", "Huge pages", "Back video frames with huge pages, applied when the sink starts", FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property(gobjectClass, PROP_RENDER_STATS,
+        g_param_spec_boxed("render-stats", "Render-Stats", "Frame, allocation and render time counters since the sink started", GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+    // When enabled, every frame is analyzed while it is converted and a
+    // "webkit-video-analysis" element message is posted each time the
+    // video becomes, or stops being, black or frozen.
+    g_object_class_install_property(gobjectClass, PROP_ANALYZE,
+        g_param_spec_boolean("analyze", "Analyze", "Detect black and frozen frames", FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property(gobjectClass, PROP_BLACK_THRESHOLD,
+        g_param_spec_double("black-threshold", "Black threshold", "Mean luma at or below which a frame is black",
+            0, 255, WEBKIT_VIDEO_SINK_DEFAULT_BLACK_THRESHOLD, G_PARAM_READWRITE));
+
+    g_object_class_install_property(gobjectClass, PROP_FROZEN_THRESHOLD,
+        g_param_spec_double("frozen-threshold", "Frozen threshold", "Largest mean luma difference of a 16x16 tile with the previous frame at or below which a frame is unchanged",
+            0, 255, WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_THRESHOLD, G_PARAM_READWRITE));
+
+    g_object_class_install_property(gobjectClass, PROP_FROZEN_FRAMES,
+        g_param_spec_uint("frozen-frames", "Frozen frames", "Consecutive unchanged frames after which the video is frozen",
+            1, G_MAXUINT, WEBKIT_VIDEO_SINK_DEFAULT_FROZEN_FRAMES, G_PARAM_READWRITE));
+
     webkitVideoSinkSignals[REPAINT_REQUESTED] = g_signal_new("repaint-requested",
             G_TYPE_FROM_CLASS(klass),
             G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
@@ -463,4 +1066,19 @@ static void webkit_video_sink_class_init(WebKitVideoSinkClass* klass)
             G_TYPE_NONE, // Return type
             1, // Only one parameter
             GST_TYPE_BUFFER);
+
+    // Returns the last frame handed to the repaint handler, premultiplied,
+    // without copying it. When the frame exceeds the given bounds (0 means
+    // unbounded) a scaled down copy keeping the aspect ratio is built
+    // instead and cached until the next frame.
+    webkitVideoSinkSignals[SNAPSHOT] = g_signal_new("snapshot",
+            G_TYPE_FROM_CLASS(klass),
+            G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+            G_STRUCT_OFFSET(WebKitVideoSinkClass, snapshot),
+            0, // Accumulator
+            0, // Accumulator data
+            g_cclosure_marshal_generic,
+            GST_TYPE_SAMPLE, // Return type
+            2, // Maximum width and height
+            G_TYPE_UINT, G_TYPE_UINT);
 }
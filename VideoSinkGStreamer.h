@@ -22,6 +22,13 @@
 
 #include <gst/video/gstvideosink.h>
 
+// CAIRO_FORMAT_RGB24 used to render the video buffers is little/big endian dependant.
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define WEBKIT_VIDEO_SINK_CAPS_FORMAT "{ BGRx, BGRA }"
+#else
+#define WEBKIT_VIDEO_SINK_CAPS_FORMAT "{ xRGB, ARGB }"
+#endif
+
 #define WEBKIT_TYPE_VIDEO_SINK webkit_video_sink_get_type()
 
 #define WEBKIT_VIDEO_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), WEBKIT_TYPE_VIDEO_SINK, WebKitVideoSink))
@@ -42,8 +49,10 @@ struct _WebKitVideoSink {
 struct _WebKitVideoSinkClass {
     GstVideoSinkClass parent_class;
 
+    // Action signals
+    GstSample* (* snapshot)(WebKitVideoSink*, guint maxWidth, guint maxHeight);
+
     // Future padding
-    void (* _webkit_reserved1)(void);
     void (* _webkit_reserved2)(void);
     void (* _webkit_reserved3)(void);
     void (* _webkit_reserved4)(void);
@@ -0,0 +1,657 @@
+/*
+ *
+ * WebKitVideoWallSink is the multi-stream variant of WebKitVideoSink,
+ * for processes showing many videos at once. Every stream links to a
+ * "sink_%u" request pad.
+ *
+ * Instead of one blocking handoff and one main loop source per
+ * stream, the streaming threads hand their buffers to a conversion
+ * thread pool shared by every wall sink of the process, and a single
+ * main loop source per element delivers, in one "repaint-requested"
+ * emission, the latest frame of every stream updated since the
+ * previous one. Frames superseded before the main loop picked them
+ * are dropped, and so are the ones queued before a flush. EOS is
+ * posted once every stream ended and its last frame was delivered.
+ *
+ * Unlike WebKitVideoSink the element does not preroll: it reaches
+ * PAUSED without waiting for data, so gst_element_get_state() and
+ * seeks in PAUSED return before a frame is shown. Frames reaching
+ * the element in PAUSED are held until the pipeline plays.
+ */
+
+#include "VideoWallSinkGStreamer.h"
+
+#include "GStreamerUtilities.h"
+#include "VideoSinkGStreamer.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <gst/video/video.h>
+
+// Frames per stream handed to the conversion pool and not yet taken
+// by the main loop; the streaming thread blocks beyond that, so a slow
+// main loop throttles decoding.
+#define WEBKIT_VIDEO_WALL_SINK_MAX_IN_FLIGHT 2
+
+static GstStaticPadTemplate s_sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(WEBKIT_VIDEO_SINK_CAPS_FORMAT)));
+
+GST_DEBUG_CATEGORY_STATIC(webkitVideoWallSinkDebug);
+#define GST_CAT_DEFAULT webkitVideoWallSinkDebug
+
+enum {
+    REPAINT_REQUESTED,
+    LAST_SIGNAL
+};
+
+enum {
+    PROP_0,
+    PROP_SYNC,
+};
+
+static guint webkitVideoWallSinkSignals[LAST_SIGNAL] = { 0, };
+
+typedef struct {
+    guint index;
+
+    // Only accessed from the streaming thread.
+    GstVideoInfo info;
+    GstCaps* caps;
+    GstSegment segment;
+    guint64 lastSequence;
+
+    // Protected by the sink mutex
+    GstClockID clockId;
+    bool flushing;
+    bool eos;
+    guint inFlight;
+    GstSample* pendingSample;
+    guint64 pendingSequence;
+    // Frames accounted in flight until the main loop takes the pending
+    // sample: the sample itself and the ones it superseded.
+    guint pendingFrames;
+    // Bumped by every flush, conversions queued before it are dropped.
+    guint flushGeneration;
+} WallStream;
+
+typedef struct {
+    WebKitVideoWallSink* sink;
+    GstPad* pad;
+    GstBuffer* buffer;
+    GstCaps* caps;
+    GstVideoInfo info;
+    guint64 sequence;
+    guint flushGeneration;
+} ConversionJob;
+
+struct _WebKitVideoWallSinkPrivate {
+    GMutex mutex;
+    GCond condition;
+
+    // Protected by the mutex
+    GPtrArray* streams;
+    guint nextIndex;
+    guint dispatchSourceId;
+    bool dispatching;
+    bool playing;
+    // Every stream got EOS, the message waits for their last frames.
+    bool eosPending;
+
+    bool sync;
+};
+
+static GQuark s_wallStreamQuark;
+
+#define webkit_video_wall_sink_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE(WebKitVideoWallSink, webkit_video_wall_sink, GST_TYPE_ELEMENT, GST_DEBUG_CATEGORY_INIT(webkitVideoWallSinkDebug, "webkitwallsink", 0, "webkit video wall sink"))
+
+static void webkitVideoWallSinkConvert(gpointer data, gpointer userData);
+
+static GThreadPool* conversionPool(void)
+{
+    static gsize pool = 0;
+
+    if (g_once_init_enter(&pool))
+        g_once_init_leave(&pool, (gsize) g_thread_pool_new(webkitVideoWallSinkConvert, 0, g_get_num_processors(), FALSE, 0));
+
+    return (GThreadPool*) pool;
+}
+
+static WallStream* wallStream(GstPad* pad)
+{
+    return g_object_get_qdata(G_OBJECT(pad), s_wallStreamQuark);
+}
+
+static void wallStreamFree(WallStream* stream)
+{
+    if (stream->caps)
+        gst_caps_unref(stream->caps);
+    if (stream->pendingSample)
+        gst_sample_unref(stream->pendingSample);
+    g_slice_free(WallStream, stream);
+}
+
+static void webkit_video_wall_sink_init(WebKitVideoWallSink* sink)
+{
+    sink->priv = G_TYPE_INSTANCE_GET_PRIVATE(sink, WEBKIT_TYPE_VIDEO_WALL_SINK, WebKitVideoWallSinkPrivate);
+
+    g_mutex_init(&sink->priv->mutex);
+    g_cond_init(&sink->priv->condition);
+    sink->priv->streams = g_ptr_array_new();
+    sink->priv->sync = TRUE;
+
+    GST_OBJECT_FLAG_SET(sink, GST_ELEMENT_FLAG_SINK);
+}
+
+// Must be called with the mutex held. The EOS message is only posted
+// once every stream ended and the main loop delivered all their frames.
+static bool webkitVideoWallSinkTakeEos(WebKitVideoWallSinkPrivate* priv)
+{
+    if (!priv->eosPending || priv->dispatching)
+        return false;
+
+    for (guint i = 0; i < priv->streams->len; i++) {
+        WallStream* stream = g_ptr_array_index(priv->streams, i);
+        if (!stream->eos || stream->inFlight)
+            return false;
+    }
+
+    priv->eosPending = false;
+    return true;
+}
+
+static gboolean webkitVideoWallSinkDispatchCallback(gpointer data)
+{
+    WebKitVideoWallSink* sink = data;
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+
+    GPtrArray* samples = g_ptr_array_new_with_free_func((GDestroyNotify) gst_sample_unref);
+
+    g_mutex_lock(&priv->mutex);
+    priv->dispatchSourceId = 0;
+    priv->dispatching = true;
+    for (guint i = 0; i < priv->streams->len; i++) {
+        WallStream* stream = g_ptr_array_index(priv->streams, i);
+        if (stream->pendingSample) {
+            g_ptr_array_add(samples, stream->pendingSample);
+            stream->pendingSample = 0;
+            stream->inFlight -= stream->pendingFrames;
+            stream->pendingFrames = 0;
+        }
+    }
+    g_cond_broadcast(&priv->condition);
+    g_mutex_unlock(&priv->mutex);
+
+    if (samples->len)
+        g_signal_emit(sink, webkitVideoWallSinkSignals[REPAINT_REQUESTED], 0, samples);
+
+    g_ptr_array_unref(samples);
+
+    g_mutex_lock(&priv->mutex);
+    priv->dispatching = false;
+    bool postEos = webkitVideoWallSinkTakeEos(priv);
+    g_mutex_unlock(&priv->mutex);
+
+    if (postEos)
+        gst_element_post_message(GST_ELEMENT(sink), gst_message_new_eos(GST_OBJECT(sink)));
+
+    return FALSE;
+}
+
+static void conversionJobFree(ConversionJob* job)
+{
+    if (job->buffer)
+        gst_buffer_unref(job->buffer);
+    gst_caps_unref(job->caps);
+    gst_object_unref(job->pad);
+    gst_object_unref(job->sink);
+    g_slice_free(ConversionJob, job);
+}
+
+static void webkitVideoWallSinkConvert(gpointer data, gpointer userData)
+{
+    ConversionJob* job = data;
+    WebKitVideoWallSink* sink = job->sink;
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+    WallStream* stream = wallStream(job->pad);
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&job->info);
+
+    GstBuffer* buffer = job->buffer;
+    job->buffer = 0;
+
+    if (format == GST_VIDEO_FORMAT_ARGB || format == GST_VIDEO_FORMAT_BGRA) {
+        GstBuffer* newBuffer = createGstBuffer(buffer);
+        GstVideoFrame sourceFrame;
+        GstVideoFrame destinationFrame;
+
+        bool converted = false;
+
+        if (newBuffer && gst_video_frame_map(&sourceFrame, &job->info, buffer, GST_MAP_READ)) {
+            if (gst_video_frame_map(&destinationFrame, &job->info, newBuffer, GST_MAP_WRITE)) {
+                premultiplyVideoFrame(&sourceFrame, &destinationFrame, 0, 0);
+                gst_video_frame_unmap(&destinationFrame);
+                converted = true;
+            }
+            gst_video_frame_unmap(&sourceFrame);
+        }
+
+        if (!converted && newBuffer) {
+            GST_WARNING_OBJECT(job->pad, "Failed to map frame, dropping it");
+            gst_buffer_unref(newBuffer);
+            newBuffer = 0;
+        }
+
+        gst_buffer_unref(buffer);
+        buffer = newBuffer;
+    }
+
+    GstSample* sample = 0;
+    if (buffer) {
+        sample = gst_sample_new(buffer, job->caps, 0, gst_structure_new("webkit-video-wall-stream", "stream", G_TYPE_UINT, stream->index, NULL));
+        gst_buffer_unref(buffer);
+    }
+
+    g_mutex_lock(&priv->mutex);
+
+    // A conversion queued before a flush that completes after it would
+    // show a frame from before the seek.
+    if (!sample || stream->flushing || job->flushGeneration != stream->flushGeneration)
+        stream->inFlight--;
+    else if (job->sequence < stream->pendingSequence) {
+        // Conversions can complete out of order, never replace a newer
+        // frame. The late one stays in flight until the newer is taken.
+        GST_LOG_OBJECT(job->pad, "Dropping frame completed after a newer one");
+        if (stream->pendingSample)
+            stream->pendingFrames++;
+        else
+            stream->inFlight--;
+    } else {
+        if (stream->pendingSample) {
+            GST_LOG_OBJECT(job->pad, "Dropping frame not picked by the main loop");
+            gst_sample_unref(stream->pendingSample);
+        }
+        stream->pendingSample = sample;
+        stream->pendingSequence = job->sequence;
+        stream->pendingFrames++;
+        sample = 0;
+
+        // This should likely use a lower priority, but glib currently starves
+        // lower priority sources.
+        // See: https://bugzilla.gnome.org/show_bug.cgi?id=610830.
+        if (!priv->dispatchSourceId) {
+            priv->dispatchSourceId = g_timeout_add_full(G_PRIORITY_DEFAULT, 0, webkitVideoWallSinkDispatchCallback,
+                                                        gst_object_ref(sink), (GDestroyNotify) gst_object_unref);
+            g_source_set_name_by_id(priv->dispatchSourceId, "[WebKit] webkitVideoWallSinkDispatchCallback");
+        }
+    }
+
+    bool postEos = webkitVideoWallSinkTakeEos(priv);
+    g_cond_broadcast(&priv->condition);
+    g_mutex_unlock(&priv->mutex);
+
+    if (postEos)
+        gst_element_post_message(GST_ELEMENT(sink), gst_message_new_eos(GST_OBJECT(sink)));
+
+    if (sample)
+        gst_sample_unref(sample);
+    conversionJobFree(job);
+}
+
+// Blocks until the running time of the buffer, returns FALSE when flushing.
+static bool webkitVideoWallSinkWaitClock(WebKitVideoWallSink* sink, WallStream* stream, GstBuffer* buffer)
+{
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+        return true;
+
+    GstClockTime runningTime = gst_segment_to_running_time(&stream->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (!GST_CLOCK_TIME_IS_VALID(runningTime))
+        return true;
+
+    g_mutex_lock(&priv->mutex);
+    while (!stream->flushing) {
+        // The element does not preroll, frames are held until the pipeline plays.
+        if (!priv->playing) {
+            g_cond_wait(&priv->condition, &priv->mutex);
+            continue;
+        }
+
+        GstClock* clock = gst_element_get_clock(GST_ELEMENT(sink));
+        if (!clock)
+            break;
+
+        stream->clockId = gst_clock_new_single_shot_id(clock, runningTime + gst_element_get_base_time(GST_ELEMENT(sink)));
+        gst_object_unref(clock);
+        g_mutex_unlock(&priv->mutex);
+
+        GstClockReturn result = gst_clock_id_wait(stream->clockId, 0);
+
+        g_mutex_lock(&priv->mutex);
+        gst_clock_id_unref(stream->clockId);
+        stream->clockId = 0;
+
+        // Unscheduled either by a flush or by going back to PAUSED.
+        if (result != GST_CLOCK_UNSCHEDULED)
+            break;
+    }
+
+    bool flushing = stream->flushing;
+    g_mutex_unlock(&priv->mutex);
+    return !flushing;
+}
+
+static GstFlowReturn webkitVideoWallSinkChain(GstPad* pad, GstObject* parent, GstBuffer* buffer)
+{
+    WebKitVideoWallSink* sink = WEBKIT_VIDEO_WALL_SINK(parent);
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+    WallStream* stream = wallStream(pad);
+
+    if (!stream->caps) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    if (priv->sync && !webkitVideoWallSinkWaitClock(sink, stream, buffer)) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_FLUSHING;
+    }
+
+    g_mutex_lock(&priv->mutex);
+    while (stream->inFlight >= WEBKIT_VIDEO_WALL_SINK_MAX_IN_FLIGHT && !stream->flushing)
+        g_cond_wait(&priv->condition, &priv->mutex);
+
+    if (stream->flushing) {
+        g_mutex_unlock(&priv->mutex);
+        gst_buffer_unref(buffer);
+        return GST_FLOW_FLUSHING;
+    }
+
+    stream->inFlight++;
+    guint flushGeneration = stream->flushGeneration;
+    g_mutex_unlock(&priv->mutex);
+
+    ConversionJob* job = g_slice_new(ConversionJob);
+    job->sink = gst_object_ref(sink);
+    job->pad = gst_object_ref(pad);
+    job->buffer = buffer;
+    job->caps = gst_caps_ref(stream->caps);
+    job->info = stream->info;
+    job->sequence = ++stream->lastSequence;
+    job->flushGeneration = flushGeneration;
+
+    g_thread_pool_push(conversionPool(), job, 0);
+    return GST_FLOW_OK;
+}
+
+static void webkitVideoWallSinkSetFlushing(WebKitVideoWallSink* sink, WallStream* stream, bool flushing)
+{
+    // Must be called with the mutex held.
+    stream->flushing = flushing;
+    if (flushing)
+        stream->flushGeneration++;
+    if (flushing && stream->clockId)
+        gst_clock_id_unschedule(stream->clockId);
+    if (stream->pendingSample) {
+        gst_sample_unref(stream->pendingSample);
+        stream->pendingSample = 0;
+    }
+    stream->inFlight -= stream->pendingFrames;
+    stream->pendingFrames = 0;
+    g_cond_broadcast(&sink->priv->condition);
+}
+
+static gboolean webkitVideoWallSinkEvent(GstPad* pad, GstObject* parent, GstEvent* event)
+{
+    WebKitVideoWallSink* sink = WEBKIT_VIDEO_WALL_SINK(parent);
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+    WallStream* stream = wallStream(pad);
+
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+        GstCaps* caps;
+        gst_event_parse_caps(event, &caps);
+
+        GstVideoInfo info;
+        if (!gst_video_info_from_caps(&info, caps)) {
+            GST_ERROR_OBJECT(pad, "Invalid caps %" GST_PTR_FORMAT, caps);
+            gst_event_unref(event);
+            return FALSE;
+        }
+
+        GST_DEBUG_OBJECT(pad, "Setting caps %" GST_PTR_FORMAT, caps);
+        stream->info = info;
+        gst_caps_replace(&stream->caps, caps);
+        break;
+    }
+    case GST_EVENT_SEGMENT:
+        gst_event_copy_segment(event, &stream->segment);
+        break;
+    case GST_EVENT_FLUSH_START:
+        g_mutex_lock(&priv->mutex);
+        webkitVideoWallSinkSetFlushing(sink, stream, true);
+        g_mutex_unlock(&priv->mutex);
+        break;
+    case GST_EVENT_FLUSH_STOP:
+        gst_segment_init(&stream->segment, GST_FORMAT_TIME);
+        g_mutex_lock(&priv->mutex);
+        webkitVideoWallSinkSetFlushing(sink, stream, false);
+        stream->eos = false;
+        g_mutex_unlock(&priv->mutex);
+        break;
+    case GST_EVENT_EOS: {
+        // Posted here only if the main loop already took every frame,
+        // otherwise once it does.
+        g_mutex_lock(&priv->mutex);
+        stream->eos = true;
+        priv->eosPending = true;
+        bool postEos = webkitVideoWallSinkTakeEos(priv);
+        g_mutex_unlock(&priv->mutex);
+
+        if (postEos)
+            gst_element_post_message(GST_ELEMENT(sink), gst_message_new_eos(GST_OBJECT(sink)));
+        break;
+    }
+    default:
+        break;
+    }
+
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static gboolean webkitVideoWallSinkQuery(GstPad* pad, GstObject* parent, GstQuery* query)
+{
+    if (GST_QUERY_TYPE(query) == GST_QUERY_ALLOCATION) {
+        gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, 0);
+        gst_query_add_allocation_meta(query, GST_VIDEO_CROP_META_API_TYPE, 0);
+        return TRUE;
+    }
+
+    return gst_pad_query_default(pad, parent, query);
+}
+
+static GstPad* webkitVideoWallSinkRequestNewPad(GstElement* element, GstPadTemplate* padTemplate, const gchar* name, const GstCaps* caps)
+{
+    WebKitVideoWallSink* sink = WEBKIT_VIDEO_WALL_SINK(element);
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+
+    g_mutex_lock(&priv->mutex);
+    guint index = priv->nextIndex;
+    if (name && sscanf(name, "sink_%u", &index) != 1) {
+        g_mutex_unlock(&priv->mutex);
+        GST_WARNING_OBJECT(sink, "Invalid pad name %s", name);
+        return 0;
+    }
+    priv->nextIndex = MAX(priv->nextIndex, index + 1);
+    g_mutex_unlock(&priv->mutex);
+
+    gchar* padName = g_strdup_printf("sink_%u", index);
+    GstPad* pad = gst_pad_new_from_template(padTemplate, padName);
+    g_free(padName);
+
+    gst_pad_set_chain_function(pad, webkitVideoWallSinkChain);
+    gst_pad_set_event_function(pad, webkitVideoWallSinkEvent);
+    gst_pad_set_query_function(pad, webkitVideoWallSinkQuery);
+
+    WallStream* stream = g_slice_new0(WallStream);
+    stream->index = index;
+    gst_video_info_init(&stream->info);
+    gst_segment_init(&stream->segment, GST_FORMAT_TIME);
+    g_object_set_qdata_full(G_OBJECT(pad), s_wallStreamQuark, stream, (GDestroyNotify) wallStreamFree);
+
+    if (!gst_element_add_pad(element, pad)) {
+        gst_object_unref(pad);
+        return 0;
+    }
+
+    g_mutex_lock(&priv->mutex);
+    g_ptr_array_add(priv->streams, stream);
+    g_mutex_unlock(&priv->mutex);
+
+    return pad;
+}
+
+static void webkitVideoWallSinkReleasePad(GstElement* element, GstPad* pad)
+{
+    WebKitVideoWallSink* sink = WEBKIT_VIDEO_WALL_SINK(element);
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+    WallStream* stream = wallStream(pad);
+
+    // Pending conversions hold a reference to the pad, and with it the stream.
+    g_mutex_lock(&priv->mutex);
+    g_ptr_array_remove(priv->streams, stream);
+    webkitVideoWallSinkSetFlushing(sink, stream, true);
+    g_mutex_unlock(&priv->mutex);
+
+    gst_element_remove_pad(element, pad);
+}
+
+static GstStateChangeReturn webkitVideoWallSinkChangeState(GstElement* element, GstStateChange transition)
+{
+    WebKitVideoWallSink* sink = WEBKIT_VIDEO_WALL_SINK(element);
+    WebKitVideoWallSinkPrivate* priv = sink->priv;
+
+    switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+        g_mutex_lock(&priv->mutex);
+        priv->eosPending = false;
+        for (guint i = 0; i < priv->streams->len; i++) {
+            WallStream* stream = g_ptr_array_index(priv->streams, i);
+            webkitVideoWallSinkSetFlushing(sink, stream, false);
+            stream->eos = false;
+        }
+        g_mutex_unlock(&priv->mutex);
+        break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+        g_mutex_lock(&priv->mutex);
+        priv->playing = true;
+        g_cond_broadcast(&priv->condition);
+        g_mutex_unlock(&priv->mutex);
+        break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+        g_mutex_lock(&priv->mutex);
+        priv->playing = false;
+        for (guint i = 0; i < priv->streams->len; i++) {
+            WallStream* stream = g_ptr_array_index(priv->streams, i);
+            if (stream->clockId)
+                gst_clock_id_unschedule(stream->clockId);
+        }
+        g_mutex_unlock(&priv->mutex);
+        break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+        // Unblock the streaming threads before the pads are deactivated.
+        g_mutex_lock(&priv->mutex);
+        for (guint i = 0; i < priv->streams->len; i++)
+            webkitVideoWallSinkSetFlushing(sink, g_ptr_array_index(priv->streams, i), true);
+        g_mutex_unlock(&priv->mutex);
+        break;
+    default:
+        break;
+    }
+
+    GstStateChangeReturn result = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        g_mutex_lock(&priv->mutex);
+        if (priv->dispatchSourceId) {
+            g_source_remove(priv->dispatchSourceId);
+            priv->dispatchSourceId = 0;
+        }
+        g_mutex_unlock(&priv->mutex);
+    }
+
+    return result;
+}
+
+static void webkitVideoWallSinkFinalize(GObject* object)
+{
+    WebKitVideoWallSinkPrivate* priv = WEBKIT_VIDEO_WALL_SINK(object)->priv;
+
+    g_ptr_array_unref(priv->streams);
+    g_cond_clear(&priv->condition);
+    g_mutex_clear(&priv->mutex);
+
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void webkitVideoWallSinkGetProperty(GObject* object, guint propertyId, GValue* value, GParamSpec* parameterSpec)
+{
+    WebKitVideoWallSinkPrivate* priv = WEBKIT_VIDEO_WALL_SINK(object)->priv;
+
+    switch (propertyId) {
+    case PROP_SYNC:
+        g_value_set_boolean(value, priv->sync);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, parameterSpec);
+    }
+}
+
+static void webkitVideoWallSinkSetProperty(GObject* object, guint propertyId, const GValue* value, GParamSpec* parameterSpec)
+{
+    WebKitVideoWallSinkPrivate* priv = WEBKIT_VIDEO_WALL_SINK(object)->priv;
+
+    switch (propertyId) {
+    case PROP_SYNC:
+        priv->sync = g_value_get_boolean(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, parameterSpec);
+    }
+}
+
+static void webkit_video_wall_sink_class_init(WebKitVideoWallSinkClass* klass)
+{
+    GObjectClass* gobjectClass = G_OBJECT_CLASS(klass);
+    GstElementClass* elementClass = GST_ELEMENT_CLASS(klass);
+
+    gst_element_class_add_pad_template(elementClass, gst_static_pad_template_get(&s_sinkTemplate));
+    gst_element_class_set_metadata(elementClass, "WebKit video wall sink", "Sink/Video", "Sends video data from many streams to WebKit in batches", "Igalia");
+
+    g_type_class_add_private(klass, sizeof(WebKitVideoWallSinkPrivate));
+
+    gobjectClass->finalize = webkitVideoWallSinkFinalize;
+    gobjectClass->get_property = webkitVideoWallSinkGetProperty;
+    gobjectClass->set_property = webkitVideoWallSinkSetProperty;
+
+    elementClass->request_new_pad = webkitVideoWallSinkRequestNewPad;
+    elementClass->release_pad = webkitVideoWallSinkReleasePad;
+    elementClass->change_state = webkitVideoWallSinkChangeState;
+
+    g_object_class_install_property(gobjectClass, PROP_SYNC,
+        g_param_spec_boolean("sync", "Sync", "Present frames at their running time on the pipeline clock", TRUE, G_PARAM_READWRITE));
+
+    // The parameter is a GPtrArray of GstSample, one per stream updated
+    // since the previous emission. The info structure of each sample
+    // holds the index of its stream in the "stream" field.
+    webkitVideoWallSinkSignals[REPAINT_REQUESTED] = g_signal_new("repaint-requested",
+            G_TYPE_FROM_CLASS(klass),
+            G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+            0, // Class offset
+            0, // Accumulator
+            0, // Accumulator data
+            g_cclosure_marshal_generic,
+            G_TYPE_NONE, // Return type
+            1, // Only one parameter
+            G_TYPE_PTR_ARRAY);
+
+    s_wallStreamQuark = g_quark_from_static_string("webkit-video-wall-stream");
+}
@@ -0,0 +1,29 @@
+#ifndef VideoWallSinkGStreamer_h
+#define VideoWallSinkGStreamer_h
+
+#include <gst/gst.h>
+
+#define WEBKIT_TYPE_VIDEO_WALL_SINK webkit_video_wall_sink_get_type()
+
+#define WEBKIT_VIDEO_WALL_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), WEBKIT_TYPE_VIDEO_WALL_SINK, WebKitVideoWallSink))
+#define WEBKIT_VIDEO_WALL_SINK_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), WEBKIT_TYPE_VIDEO_WALL_SINK, WebKitVideoWallSinkClass))
+#define WEBKIT_IS_VIDEO_WALL_SINK(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), WEBKIT_TYPE_VIDEO_WALL_SINK))
+#define WEBKIT_IS_VIDEO_WALL_SINK_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), WEBKIT_TYPE_VIDEO_WALL_SINK))
+#define WEBKIT_VIDEO_WALL_SINK_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), WEBKIT_TYPE_VIDEO_WALL_SINK, WebKitVideoWallSinkClass))
+
+typedef struct _WebKitVideoWallSink WebKitVideoWallSink;
+typedef struct _WebKitVideoWallSinkClass WebKitVideoWallSinkClass;
+typedef struct _WebKitVideoWallSinkPrivate WebKitVideoWallSinkPrivate;
+
+struct _WebKitVideoWallSink {
+    GstElement parent;
+    WebKitVideoWallSinkPrivate* priv;
+};
+
+struct _WebKitVideoWallSinkClass {
+    GstElementClass parent_class;
+};
+
+GType webkit_video_wall_sink_get_type(void) G_GNUC_CONST;
+
+#endif
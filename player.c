@@ -1,8 +1,11 @@
 #include <stdbool.h>
 #include <assert.h>
+#include <stdio.h>
+#include <sys/resource.h>
 #include <gst/gst.h>
 
 #include "GStreamerUtilities.h"
+#include "VideoFramePainter.h"
 
 // GstPlayFlags flags from playbin2. It is the policy of GStreamer to
 // not publicly expose element-specific enums. That's why this
@@ -26,16 +29,372 @@ typedef struct {
     char* url;
     GMainLoop* loop;
     guint repaintHandler;
+
+    // Benchmark counters, reset for every URL.
+    guint frameCount;
+    gint64 startTime;
+    gint64 startCpuTime;
+
+    VideoFramePainter* painter;
+
+    // Seek benchmark state, reset for every URL.
+    GArray* seekPositions;
+    guint seekIndex;
+    bool seekStarted;
+    bool waitingForRepaint;
+    bool waitingForAsyncDone;
+    gint64 seekStartTime;
+    guint seekTimeoutId;
+    guint seekIdleId;
+    // Seqnum of the pending seek, and of the segment the video sink
+    // currently renders, set from the streaming thread.
+    guint32 seekSeqnum;
+    gint segmentSeqnum;
+    GArray* seekRepaintLatencies;
+    GArray* seekAsyncDoneLatencies;
 } MediaPlayerPrivateGStreamer;
 
+static gboolean s_hugePages = FALSE;
+static gboolean s_benchmark = FALSE;
+static gboolean s_latencyTracer = FALSE;
+static gboolean s_paint = FALSE;
+static char* s_paintSize = NULL;
+static int s_paintTiles = 1;
+static int s_thumbnails = 0;
+static int s_thumbnailWidth = 320;
+static int s_jobs = 0;
+static char* s_outputDirectory = NULL;
+static char* s_seekPositions = NULL;
+static int s_seekRandom = 0;
+static char* s_seekFlags = NULL;
+static gboolean s_analyze = FALSE;
+
+static GOptionEntry s_options[] = {
+    { "huge-pages", 0, 0, G_OPTION_ARG_NONE, &s_hugePages, "Back video frames with huge pages", NULL },
+    { "benchmark", 0, 0, G_OPTION_ARG_NONE, &s_benchmark, "Render as fast as possible and report frame rate and CPU time", NULL },
+    { "latency-tracer", 0, 0, G_OPTION_ARG_NONE, &s_latencyTracer, "Report per-element and end-to-end latency at EOS", NULL },
+    { "paint", 0, 0, G_OPTION_ARG_NONE, &s_paint, "Composite every frame with cairo onto an offscreen surface and report paint time", NULL },
+    { "paint-size", 0, 0, G_OPTION_ARG_STRING, &s_paintSize, "Size of the offscreen surface (default 1280x720)", "WIDTHxHEIGHT" },
+    { "paint-tiles", 0, 0, G_OPTION_ARG_INT, &s_paintTiles, "Number of tiles painted in parallel (default 1)", "N" },
+    { "thumbnails", 0, 0, G_OPTION_ARG_INT, &s_thumbnails, "Extract N evenly spaced keyframe thumbnails per URI instead of playing", "N" },
+    { "thumbnail-width", 0, 0, G_OPTION_ARG_INT, &s_thumbnailWidth, "Maximum thumbnail width (default 320)", "WIDTH" },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &s_jobs, "Number of URIs processed in parallel (default: number of CPUs)", "N" },
+    { "output-dir", 0, 0, G_OPTION_ARG_FILENAME, &s_outputDirectory, "Directory thumbnails are written to (default: current directory)", "DIR" },
+    { "seek", 0, 0, G_OPTION_ARG_STRING, &s_seekPositions, "Seek to each position once prerolled and report seek latency", "SECONDS,..." },
+    { "seek-random", 0, 0, G_OPTION_ARG_INT, &s_seekRandom, "Seek to N random positions once prerolled and report seek latency", "N" },
+    { "seek-flags", 0, 0, G_OPTION_ARG_STRING, &s_seekFlags, "Seek flags among flush, key-unit, accurate, snap-before, snap-after and snap-nearest (default flush,key-unit)", "FLAG,..." },
+    { "analyze", 0, 0, G_OPTION_ARG_NONE, &s_analyze, "Report when the video becomes, or stops being, black or frozen", NULL },
+    { NULL }
+};
+
+static gint64 cpuTime(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void reportBenchmark(MediaPlayerPrivateGStreamer *m)
+{
+    double elapsed = (double) (g_get_monotonic_time() - m->startTime) / G_USEC_PER_SEC;
+    double cpu = (double) (cpuTime() - m->startCpuTime) / G_USEC_PER_SEC;
+
+    g_print("\n%s: %u frames in %.3f s (%.1f fps), %.3f s CPU (%.3f ms/frame)%s\n",
+            m->url, m->frameCount, elapsed, elapsed > 0 ? m->frameCount / elapsed : 0,
+            cpu, m->frameCount ? cpu * 1000 / m->frameCount : 0,
+            s_hugePages ? ", huge pages" : "");
+
+    GstStructure* stats = NULL;
+    g_object_get(m->webkitVideoSink, "render-stats", &stats, NULL);
+    if (!stats)
+        return;
+
+    guint64 frames = 0, rendered = 0, premultiplied = 0, allocated = 0, totalRenderTime = 0, maxRenderTime = 0;
+    gst_structure_get(stats, "frames", G_TYPE_UINT64, &frames,
+                      "rendered", G_TYPE_UINT64, &rendered,
+                      "premultiplied", G_TYPE_UINT64, &premultiplied,
+                      "allocated", G_TYPE_UINT64, &allocated,
+                      "total-render-time", G_TYPE_UINT64, &totalRenderTime,
+                      "max-render-time", G_TYPE_UINT64, &maxRenderTime, NULL);
+    gst_structure_free(stats);
+
+    g_print("sink: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " rendered, %" G_GUINT64_FORMAT " premultiplied, %.2f allocations/frame, render %" G_GUINT64_FORMAT " ns/frame (max %" G_GUINT64_FORMAT " ns)\n",
+            frames, rendered, premultiplied, frames ? (double) allocated / frames : 0,
+            frames ? totalRenderTime / frames : 0, maxRenderTime);
+}
+
+static void reportPaint(MediaPlayerPrivateGStreamer *m)
+{
+    VideoFramePainterStats stats;
+    videoFramePainterGetStats(m->painter, &stats);
+
+    g_print("paint: %" G_GUINT64_FORMAT " frames, mean %.3f ms, max %.3f ms\n", stats.frames,
+            stats.frames ? (double) stats.totalPaintTime / stats.frames / 1000 : 0,
+            (double) stats.maxPaintTime / 1000);
+}
+
+static void resetBenchmark(MediaPlayerPrivateGStreamer *m)
+{
+    m->frameCount = 0;
+    m->startTime = g_get_monotonic_time();
+    m->startCpuTime = cpuTime();
+    if (m->painter)
+        videoFramePainterResetStats(m->painter);
+}
+
 static void didEnd(MediaPlayerPrivateGStreamer *m)
 {
+    if (s_benchmark)
+        reportBenchmark(m);
+
+    if (m->painter)
+        reportPaint(m);
+
     g_main_loop_quit (m->loop);
 }
 
+// Scripted seek benchmark. Once the pipeline prerolled, every seek is
+// issued after the previous one got both its repaint and, for
+// flushing seeks, its ASYNC_DONE. The pipeline stays paused unless
+// the seeks don't flush, as those can't complete while prerolled.
+// Every seek is tagged with the seqnum of its event, which demuxers
+// copy to the segments and sinks to ASYNC_DONE, so a late repaint or
+// ASYNC_DONE of a seek that timed out doesn't count for the next one.
+#define SEEK_TIMEOUT_SECONDS 5
+#define RANDOM_SEEK_SEED 42
+
+#if !GST_CHECK_VERSION(1, 14, 0)
+#define GST_SEQNUM_INVALID (0)
+#endif
+
+static bool changePipelineState(MediaPlayerPrivateGStreamer* m, GstState newState);
+
+static int compareDoubles(gconstpointer a, gconstpointer b)
+{
+    double first = *(const double*) a;
+    double second = *(const double*) b;
+    return first < second ? -1 : first > second;
+}
+
+static bool seekBenchmarkEnabled(void)
+{
+    return s_seekPositions || s_seekRandom > 0;
+}
+
+static GstSeekFlags parseSeekFlags(void)
+{
+    static const struct {
+        const char* name;
+        GstSeekFlags flag;
+    } flagNames[] = {
+        { "flush", GST_SEEK_FLAG_FLUSH },
+        { "key-unit", GST_SEEK_FLAG_KEY_UNIT },
+        { "accurate", GST_SEEK_FLAG_ACCURATE },
+        { "snap-before", GST_SEEK_FLAG_SNAP_BEFORE },
+        { "snap-after", GST_SEEK_FLAG_SNAP_AFTER },
+        { "snap-nearest", GST_SEEK_FLAG_SNAP_NEAREST },
+    };
+
+    if (!s_seekFlags)
+        return GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+
+    GstSeekFlags flags = GST_SEEK_FLAG_NONE;
+    char** names = g_strsplit(s_seekFlags, ",", -1);
+    for (int i = 0; names[i]; i++) {
+        unsigned j;
+        for (j = 0; j < G_N_ELEMENTS(flagNames); j++) {
+            if (g_str_equal(g_strstrip(names[i]), flagNames[j].name)) {
+                flags |= flagNames[j].flag;
+                break;
+            }
+        }
+        if (j == G_N_ELEMENTS(flagNames))
+            g_printerr("Ignoring unknown seek flag %s\n", names[i]);
+    }
+    g_strfreev(names);
+
+    return flags;
+}
+
+static void printLatencyDistribution(const char* name, GArray* latencies)
+{
+    if (!latencies->len) {
+        g_print("%s: no samples\n", name);
+        return;
+    }
+
+    g_array_sort(latencies, compareDoubles);
+    double total = 0;
+    for (guint i = 0; i < latencies->len; i++)
+        total += g_array_index(latencies, double, i);
+
+    g_print("%s: %u samples, min %.1f ms, median %.1f ms, p95 %.1f ms, max %.1f ms, mean %.1f ms\n", name, latencies->len,
+            g_array_index(latencies, double, 0),
+            g_array_index(latencies, double, latencies->len / 2),
+            g_array_index(latencies, double, MIN((guint) (latencies->len * 0.95), latencies->len - 1)),
+            g_array_index(latencies, double, latencies->len - 1),
+            total / latencies->len);
+}
+
+static void resetSeekBenchmark(MediaPlayerPrivateGStreamer* m)
+{
+    if (m->seekTimeoutId) {
+        g_source_remove(m->seekTimeoutId);
+        m->seekTimeoutId = 0;
+    }
+
+    if (m->seekIdleId) {
+        g_source_remove(m->seekIdleId);
+        m->seekIdleId = 0;
+    }
+
+    if (m->seekPositions)
+        g_array_unref(m->seekPositions);
+    if (m->seekRepaintLatencies)
+        g_array_unref(m->seekRepaintLatencies);
+    if (m->seekAsyncDoneLatencies)
+        g_array_unref(m->seekAsyncDoneLatencies);
+
+    m->seekPositions = NULL;
+    m->seekRepaintLatencies = NULL;
+    m->seekAsyncDoneLatencies = NULL;
+    m->seekIndex = 0;
+    m->seekStarted = false;
+    m->waitingForRepaint = false;
+    m->waitingForAsyncDone = false;
+    m->seekSeqnum = GST_SEQNUM_INVALID;
+}
+
+static gboolean issueNextSeek(gpointer data);
+
+static void scheduleNextSeek(MediaPlayerPrivateGStreamer* m)
+{
+    // Not from within the signal or message handler.
+    if (!m->seekIdleId)
+        m->seekIdleId = g_idle_add(issueNextSeek, m);
+}
+
+static gboolean seekTimeoutCallback(gpointer data)
+{
+    MediaPlayerPrivateGStreamer* m = data;
+
+    g_printerr("Seek %u timed out\n", m->seekIndex);
+    m->seekTimeoutId = 0;
+    m->waitingForRepaint = m->waitingForAsyncDone = false;
+    m->seekSeqnum = GST_SEQNUM_INVALID;
+    scheduleNextSeek(m);
+    return FALSE;
+}
+
+static gboolean issueNextSeek(gpointer data)
+{
+    MediaPlayerPrivateGStreamer* m = data;
+
+    m->seekIdleId = 0;
+    if (m->seekIndex == m->seekPositions->len) {
+        g_print("\n%s: %u seeks\n", m->url, m->seekPositions->len);
+        printLatencyDistribution("seek to repaint", m->seekRepaintLatencies);
+        printLatencyDistribution("seek to ASYNC_DONE", m->seekAsyncDoneLatencies);
+        resetSeekBenchmark(m);
+        didEnd(m);
+        return FALSE;
+    }
+
+    GstSeekFlags flags = parseSeekFlags();
+    gint64 position = g_array_index(m->seekPositions, gint64, m->seekIndex++);
+
+    m->waitingForRepaint = true;
+    m->waitingForAsyncDone = flags & GST_SEEK_FLAG_FLUSH;
+    m->seekStartTime = g_get_monotonic_time();
+    GstEvent* event = gst_event_new_seek(1.0, GST_FORMAT_TIME, flags, GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+    m->seekSeqnum = gst_event_get_seqnum(event);
+    if (!gst_element_send_event(m->playBin, event)) {
+        g_printerr("Seek to %" GST_TIME_FORMAT " failed\n", GST_TIME_ARGS(position));
+        m->waitingForRepaint = m->waitingForAsyncDone = false;
+        m->seekSeqnum = GST_SEQNUM_INVALID;
+        scheduleNextSeek(m);
+        return FALSE;
+    }
+
+    m->seekTimeoutId = g_timeout_add_seconds(SEEK_TIMEOUT_SECONDS, seekTimeoutCallback, m);
+    return FALSE;
+}
+
+static void seekStepCompleted(MediaPlayerPrivateGStreamer* m, GArray* latencies)
+{
+    double latency = (double) (g_get_monotonic_time() - m->seekStartTime) / 1000;
+    g_array_append_val(latencies, latency);
+
+    if (m->waitingForRepaint || m->waitingForAsyncDone)
+        return;
+
+    if (m->seekTimeoutId) {
+        g_source_remove(m->seekTimeoutId);
+        m->seekTimeoutId = 0;
+    }
+
+    scheduleNextSeek(m);
+}
+
+static void startSeekBenchmark(MediaPlayerPrivateGStreamer* m)
+{
+    m->seekStarted = true;
+    m->seekPositions = g_array_new(FALSE, FALSE, sizeof(gint64));
+    m->seekRepaintLatencies = g_array_new(FALSE, FALSE, sizeof(double));
+    m->seekAsyncDoneLatencies = g_array_new(FALSE, FALSE, sizeof(double));
+
+    if (s_seekPositions) {
+        char** positions = g_strsplit(s_seekPositions, ",", -1);
+        for (int i = 0; positions[i]; i++) {
+            gint64 position = g_ascii_strtod(positions[i], NULL) * GST_SECOND;
+            g_array_append_val(m->seekPositions, position);
+        }
+        g_strfreev(positions);
+    }
+
+    gint64 duration = 0;
+    if (s_seekRandom > 0) {
+        if (gst_element_query_duration(m->playBin, GST_FORMAT_TIME, &duration) && duration > 0) {
+            // A fixed seed, so runs compare the same positions.
+            GRand* random = g_rand_new_with_seed(RANDOM_SEEK_SEED);
+            for (int i = 0; i < s_seekRandom; i++) {
+                gint64 position = g_rand_double(random) * duration;
+                g_array_append_val(m->seekPositions, position);
+            }
+            g_rand_free(random);
+        } else
+            g_printerr("Unknown duration, no random seeks\n");
+    }
+
+    // play() never runs in this mode, so --benchmark counts from here.
+    resetBenchmark(m);
+
+    if (!(parseSeekFlags() & GST_SEEK_FLAG_FLUSH))
+        changePipelineState(m, GST_STATE_PLAYING);
+
+    scheduleNextSeek(m);
+}
+
 static void mediaPlayerPrivateRepaintCallback(GstElement *sink, GstBuffer *buffer, MediaPlayerPrivateGStreamer* m)
 {
-    g_printerr(".");
+    m->frameCount++;
+
+    if (m->waitingForRepaint && (guint32) g_atomic_int_get(&m->segmentSeqnum) == m->seekSeqnum) {
+        m->waitingForRepaint = false;
+        seekStepCompleted(m, m->seekRepaintLatencies);
+    }
+
+    if (m->painter) {
+        GstCaps* caps = NULL;
+        g_object_get(m->webkitVideoSink, "current-caps", &caps, NULL);
+        videoFramePainterPaint(m->painter, buffer, caps);
+        if (caps)
+            gst_caps_unref(caps);
+    }
+
+    if (!s_benchmark)
+        g_printerr(".");
 }
 
 static void mediaPlayerPrivateVideoSinkCapsChangedCallback(GObject* object, GParamSpec* pspec, MediaPlayerPrivateGStreamer* m)
@@ -67,8 +426,36 @@ static gboolean mediaPlayerPrivateMessageCallback(GstBus* bus, GstMessage* messa
 
         break;
     case GST_MESSAGE_EOS:
+        if (seekBenchmarkEnabled())
+            resetSeekBenchmark(m);
         didEnd(m);
         break;
+    case GST_MESSAGE_ASYNC_DONE:
+        if (!messageSourceIsPlaybin || !seekBenchmarkEnabled())
+            break;
+
+        if (!m->seekStarted)
+            startSeekBenchmark(m);
+        else if (m->waitingForAsyncDone && gst_message_get_seqnum(message) == m->seekSeqnum) {
+            m->waitingForAsyncDone = false;
+            seekStepCompleted(m, m->seekAsyncDoneLatencies);
+        }
+        break;
+    case GST_MESSAGE_ELEMENT: {
+        const GstStructure* structure = gst_message_get_structure(message);
+        if (!gst_structure_has_name(structure, "webkit-video-analysis"))
+            break;
+
+        GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+        gboolean black = FALSE;
+        gboolean frozen = FALSE;
+        double meanLuma = 0;
+        gst_structure_get(structure, "timestamp", G_TYPE_UINT64, &timestamp, "black", G_TYPE_BOOLEAN, &black,
+            "frozen", G_TYPE_BOOLEAN, &frozen, "mean-luma", G_TYPE_DOUBLE, &meanLuma, NULL);
+        g_print("%" GST_TIME_FORMAT ": %s%s%s (mean luma %.1f)\n", GST_TIME_ARGS(timestamp),
+            black ? "black" : "", black && frozen ? ", " : "", frozen ? "frozen" : (black ? "" : "normal"), meanLuma);
+        break;
+    }
     case GST_MESSAGE_STATE_CHANGED: {
         if (!messageSourceIsPlaybin)
             break;
@@ -89,18 +476,35 @@ static gboolean mediaPlayerPrivateMessageCallback(GstBus* bus, GstMessage* messa
     return TRUE;
 }
 
+static GstPadProbeReturn videoSinkSegmentProbe(GstPad* pad, GstPadProbeInfo* info, MediaPlayerPrivateGStreamer* m)
+{
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+        g_atomic_int_set(&m->segmentSeqnum, gst_event_get_seqnum(event));
+    return GST_PAD_PROBE_OK;
+}
+
 static GstElement* createVideoSink(MediaPlayerPrivateGStreamer *m)
 {
     GstElement* videoSink = NULL;
 
     m->webkitVideoSink = gst_element_factory_make("wkvsink", "wkvsink");
     assert(m->webkitVideoSink);
-    g_object_set(m->webkitVideoSink, "silent", TRUE, NULL);
+    g_object_set(m->webkitVideoSink, "silent", TRUE, "huge-pages", s_hugePages, "analyze", s_analyze, NULL);
+    if (s_benchmark)
+        g_object_set(m->webkitVideoSink, "sync", FALSE, NULL);
     m->repaintHandler = g_signal_connect(m->webkitVideoSink, "repaint-requested", G_CALLBACK(mediaPlayerPrivateRepaintCallback), m);
+    if (seekBenchmarkEnabled()) {
+        GstPad* pad = gst_element_get_static_pad(m->webkitVideoSink, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, (GstPadProbeCallback) videoSinkSegmentProbe, m, NULL);
+        gst_object_unref(pad);
+    }
 
     m->fpsSink = gst_element_factory_make("fpsdisplaysink", "sink");
     if (m->fpsSink) {
         g_object_set(m->fpsSink, "silent", TRUE, "text-overlay", FALSE, "video-sink", m->webkitVideoSink, NULL);
+        if (s_benchmark)
+            g_object_set(m->fpsSink, "sync", FALSE, NULL);
         videoSink = m->fpsSink;
     }
 
@@ -172,6 +576,10 @@ static void load(MediaPlayerPrivateGStreamer *m, const char* uri)
 
     g_free(m->url);
     m->url = g_strdup(uri);
+
+    // playbin only picks up a new URI from READY, and the previous one
+    // may have left it paused, as the seek benchmark does.
+    gst_element_set_state(m->playBin, GST_STATE_READY);
     g_object_set(m->playBin, "uri", uri, NULL);
 
     /* commitLoad */
@@ -181,6 +589,8 @@ static void load(MediaPlayerPrivateGStreamer *m, const char* uri)
 
 static void play(MediaPlayerPrivateGStreamer *m)
 {
+    resetBenchmark(m);
+
     if (!changePipelineState(m, GST_STATE_PLAYING)) {
         g_printerr("Play failed!\n");
         didEnd(m);
@@ -213,6 +623,9 @@ static void destroy(MediaPlayerPrivateGStreamer *m)
 
     if (m->loop)
         g_main_loop_unref(m->loop);
+
+    if (m->painter)
+        videoFramePainterFree(m->painter);
 }
 
 static gboolean
@@ -223,20 +636,257 @@ launch(gpointer data)
     return FALSE;
 }
 
+// Batch thumbnail extraction. Every URI gets its own video-only playbin,
+// run from a worker thread, while the main thread runs the main loop
+// dispatching the repaints of all the sinks.
+typedef struct {
+    GMainLoop* loop;
+    GMutex mutex;
+    guint pending;
+    guint failed;
+    GArray* latencies;
+} ThumbnailBatch;
+
+typedef struct {
+    ThumbnailBatch* batch;
+    char* uri;
+    guint index;
+} ThumbnailJob;
+
+static bool waitForPreroll(GstElement* pipeline)
+{
+    return gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS;
+}
+
+// The pipelines are driven synchronously, without a bus watch. Their
+// bus is drained after every state change so messages do not pile up,
+// and errors are printed. Returns false if there was any.
+static bool drainBus(GstElement* pipeline, const char* uri)
+{
+    GstBus* bus = gst_element_get_bus(pipeline);
+    bool succeeded = true;
+
+    GstMessage* message;
+    while ((message = gst_bus_pop(bus))) {
+        if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+            GError* error;
+            gchar* debug;
+            gst_message_parse_error(message, &error, &debug);
+            g_printerr("Error (%s) %d: %s (url=%s)\n", GST_MESSAGE_SRC_NAME(message), error->code, error->message, uri);
+            g_error_free(error);
+            g_free(debug);
+            succeeded = false;
+        }
+        gst_message_unref(message);
+    }
+
+    gst_object_unref(bus);
+    return succeeded;
+}
+
+static bool writeThumbnail(GstSample* sample, const char* fileName)
+{
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample)))
+        return false;
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample), GST_MAP_READ))
+        return false;
+
+    cairo_surface_t* surface = createCairoSurfaceForVideoFrame(&frame);
+    bool written = cairo_surface_write_to_png(surface, fileName) == CAIRO_STATUS_SUCCESS;
+    cairo_surface_destroy(surface);
+    gst_video_frame_unmap(&frame);
+
+    return written;
+}
+
+static bool extractThumbnails(ThumbnailJob* job)
+{
+    GstElement* pipeline = gst_element_factory_make("playbin", NULL);
+    GstElement* sink = gst_element_factory_make("wkvsink", NULL);
+    if (!pipeline || !sink) {
+        if (pipeline)
+            gst_object_unref(pipeline);
+        if (sink)
+            gst_object_unref(sink);
+        return false;
+    }
+
+    // No audio decoding, and no extra reference on the prerolled buffer.
+    g_object_set(sink, "enable-last-sample", FALSE, NULL);
+    g_object_set(pipeline, "uri", job->uri, "video-sink", sink, "flags", GST_PLAY_FLAG_VIDEO, NULL);
+
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    bool succeeded = waitForPreroll(pipeline);
+    succeeded = drainBus(pipeline, job->uri) && succeeded;
+
+    gint64 duration = 0;
+    if (!succeeded || !gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration))
+        duration = 0;
+
+    char* baseName = g_path_get_basename(job->uri);
+    int count = duration > 0 ? s_thumbnails : 1;
+    for (int i = 0; succeeded && i < count; i++) {
+        // Centers of N equal intervals, so neither end is picked.
+        gint64 position = duration * (2 * i + 1) / (2 * count);
+        if (duration > 0) {
+            gst_element_seek_simple(pipeline, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, position);
+            succeeded = waitForPreroll(pipeline);
+            succeeded = drainBus(pipeline, job->uri) && succeeded;
+            if (!succeeded)
+                break;
+        }
+
+        GstSample* sample = NULL;
+        g_signal_emit_by_name(sink, "snapshot", (guint) s_thumbnailWidth, 0, &sample);
+        if (!sample) {
+            succeeded = false;
+            break;
+        }
+
+        char* fileName = g_strdup_printf("%u-%s-%02d.png", job->index, baseName, i);
+        char* path = g_build_filename(s_outputDirectory ? s_outputDirectory : ".", fileName, NULL);
+        succeeded = writeThumbnail(sample, path);
+        g_free(path);
+        g_free(fileName);
+        gst_sample_unref(sample);
+    }
+    g_free(baseName);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return succeeded;
+}
+
+static gboolean quitMainLoop(gpointer data)
+{
+    g_main_loop_quit((GMainLoop*) data);
+    return FALSE;
+}
+
+static void extractThumbnailsInThread(gpointer data, gpointer userData)
+{
+    ThumbnailJob* job = data;
+    ThumbnailBatch* batch = job->batch;
+
+    gint64 startTime = g_get_monotonic_time();
+    bool succeeded = extractThumbnails(job);
+    double latency = (double) (g_get_monotonic_time() - startTime) / 1000;
+
+    if (!succeeded)
+        g_printerr("Thumbnail extraction failed (url=%s)\n", job->uri);
+
+    g_mutex_lock(&batch->mutex);
+    g_array_append_val(batch->latencies, latency);
+    if (!succeeded)
+        batch->failed++;
+    // The main thread might not run the loop yet, and quitting a loop
+    // before it runs has no effect. Quit from the loop itself instead.
+    if (!--batch->pending)
+        g_idle_add(quitMainLoop, batch->loop);
+    g_mutex_unlock(&batch->mutex);
+
+    g_free(job->uri);
+    g_free(job);
+}
+
+static int runThumbnailBatch(int count, char** uris)
+{
+    ThumbnailBatch batch;
+    batch.loop = g_main_loop_new(NULL, FALSE);
+    g_mutex_init(&batch.mutex);
+    batch.pending = count;
+    batch.failed = 0;
+    batch.latencies = g_array_sized_new(FALSE, FALSE, sizeof(double), count);
+
+    int jobs = s_jobs > 0 ? s_jobs : (int) g_get_num_processors();
+    GThreadPool* pool = g_thread_pool_new(extractThumbnailsInThread, NULL, jobs, TRUE, NULL);
+
+    gint64 startTime = g_get_monotonic_time();
+    for (int i = 0; i < count; i++) {
+        ThumbnailJob* job = g_new0(ThumbnailJob, 1);
+        job->batch = &batch;
+        job->uri = gst_uri_is_valid(uris[i]) ? g_strdup(uris[i]) : gst_filename_to_uri(uris[i], NULL);
+        job->index = i;
+        g_thread_pool_push(pool, job, NULL);
+    }
+
+    g_main_loop_run(batch.loop);
+    double elapsed = (double) (g_get_monotonic_time() - startTime) / G_USEC_PER_SEC;
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    g_array_sort(batch.latencies, compareDoubles);
+    double total = 0;
+    for (guint i = 0; i < batch.latencies->len; i++)
+        total += g_array_index(batch.latencies, double, i);
+
+    g_print("%d files (%u failed) in %.3f s with %d jobs: %.2f files/s\n", count, batch.failed, elapsed, jobs, count / elapsed);
+    g_print("per-file latency: mean %.1f ms, median %.1f ms, max %.1f ms\n", total / count,
+            g_array_index(batch.latencies, double, count / 2),
+            g_array_index(batch.latencies, double, count - 1));
+
+    g_array_unref(batch.latencies);
+    g_mutex_clear(&batch.mutex);
+    g_main_loop_unref(batch.loop);
+
+    return batch.failed ? 1 : 0;
+}
+
 int
 main(int argc, char **argv)
 {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new("URI...");
+    g_option_context_add_main_entries(context, s_options, NULL);
+    // GStreamer options are left in argv for gst_init().
+    g_option_context_set_ignore_unknown_options(context, TRUE);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    // Tracers are instantiated by gst_init() from GST_TRACERS.
+    if (s_latencyTracer) {
+        const char* tracers = g_getenv("GST_TRACERS");
+        char* newTracers = tracers && *tracers ? g_strconcat(tracers, ";wklatency", NULL) : g_strdup("wklatency");
+        g_setenv("GST_TRACERS", newTracers, TRUE);
+        g_free(newTracers);
+    }
+
     if (!initializeGStreamer(&argc, &argv))
         return -1;
 
+    if (s_thumbnails > 0) {
+        if (argc < 2)
+            return 0;
+        return runThumbnailBatch(argc - 1, argv + 1);
+    }
+
     MediaPlayerPrivateGStreamer *m = g_new0(MediaPlayerPrivateGStreamer, 1);
+
+    if (s_paint) {
+        int width = 1280, height = 720;
+        if (s_paintSize && (sscanf(s_paintSize, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+            g_printerr("Invalid paint size: %s\n", s_paintSize);
+            return -1;
+        }
+        m->painter = videoFramePainterNew(width, height, MAX(s_paintTiles, 1));
+    }
+
     createGSTPlayBin(m);
 
     int i = 1;
     while(--argc) {
         load(m, argv[i++]);
         m->loop = g_main_loop_new(NULL, TRUE);
-        g_idle_add(launch, m);
+        // The seek benchmark starts once prerolled, and plays only if needed.
+        if (!seekBenchmarkEnabled())
+            g_idle_add(launch, m);
         g_main_loop_run(m->loop);
     }
 
@@ -1,12 +1,29 @@
 #include "VideoSinkGStreamer.h"
+#include "HugePageAllocatorGStreamer.h"
+#include "LatencyTracerGStreamer.h"
+#include "VideoWallSinkGStreamer.h"
 
 static gboolean
 webkit_plugin_init(GstPlugin* plugin)
 {
+    gst_allocator_register(WEBKIT_HUGE_PAGE_ALLOCATOR_NAME,
+                           g_object_new(WEBKIT_TYPE_HUGE_PAGE_ALLOCATOR, NULL));
+
+#if GST_CHECK_VERSION(1, 8, 0)
+    if (!gst_tracer_register(plugin,
+                             WEBKIT_LATENCY_TRACER_NAME,
+                             WEBKIT_TYPE_LATENCY_TRACER))
+        return FALSE;
+#endif
+
     return gst_element_register(plugin,
                                 "wkvsink",
                                 GST_RANK_PRIMARY,
-                                WEBKIT_TYPE_VIDEO_SINK);
+                                WEBKIT_TYPE_VIDEO_SINK)
+        && gst_element_register(plugin,
+                                "wkvwallsink",
+                                GST_RANK_NONE,
+                                WEBKIT_TYPE_VIDEO_WALL_SINK);
 }
 
 GstPluginDesc gst_plugin_desc = {
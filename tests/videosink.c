@@ -0,0 +1,781 @@
+#include "GStreamerUtilities.h"
+#include "HugePageAllocatorGStreamer.h"
+#include "VideoSinkGStreamer.h"
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+// The formats wkvsink accepts, in native byte order.
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define ALPHA_FORMAT GST_VIDEO_FORMAT_BGRA
+#define OPAQUE_FORMAT GST_VIDEO_FORMAT_BGRx
+#else
+#define ALPHA_FORMAT GST_VIDEO_FORMAT_ARGB
+#define OPAQUE_FORMAT GST_VIDEO_FORMAT_xRGB
+#endif
+
+// Multiplies the render budgets, for machines slower than a desktop.
+#define RENDER_BUDGET_SCALE_VARIABLE "WEBKIT_VIDEO_SINK_BUDGET_SCALE"
+#define WARM_UP_FRAMES 5
+#define MEASURED_FRAMES 30
+
+static GMainLoop* s_loop;
+static GThread* s_loopThread;
+
+// The sink hands every frame to the default main context and waits for
+// it there, so rendering needs a running loop.
+static gpointer runMainLoop(gpointer data)
+{
+    g_main_loop_run(data);
+    return 0;
+}
+
+static gboolean quitMainLoop(gpointer data)
+{
+    g_main_loop_quit(data);
+    return FALSE;
+}
+
+static void startMainLoop(void)
+{
+    s_loop = g_main_loop_new(0, FALSE);
+    s_loopThread = g_thread_new("main-loop", runMainLoop, s_loop);
+}
+
+static void stopMainLoop(void)
+{
+    // Through the loop itself, it might not be running yet.
+    g_idle_add(quitMainLoop, s_loop);
+    g_thread_join(s_loopThread);
+    g_main_loop_unref(s_loop);
+    s_loopThread = 0;
+    s_loop = 0;
+}
+
+static GstCaps* createCaps(GstVideoFormat format, int width, int height)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, width, height);
+    GST_VIDEO_INFO_FPS_N(&info) = 30;
+    GST_VIDEO_INFO_FPS_D(&info) = 1;
+    return gst_video_info_to_caps(&info);
+}
+
+static void paintRect(GstBuffer* buffer, GstVideoFormat format, int width, int height, int left, int top, int right, int bottom, guint8 red, guint8 green, guint8 blue, guint8 alpha)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, width, height);
+
+    int redOffset = GST_VIDEO_INFO_COMP_POFFSET(&info, GST_VIDEO_COMP_R);
+    int greenOffset = GST_VIDEO_INFO_COMP_POFFSET(&info, GST_VIDEO_COMP_G);
+    int blueOffset = GST_VIDEO_INFO_COMP_POFFSET(&info, GST_VIDEO_COMP_B);
+    // The remaining byte, alpha or padding.
+    int alphaOffset = 6 - redOffset - greenOffset - blueOffset;
+
+    GstVideoFrame frame;
+    fail_unless(gst_video_frame_map(&frame, &info, buffer, GST_MAP_WRITE));
+    for (int y = top; y < bottom; y++) {
+        guint8* pixel = (guint8*) GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) + y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0) + left * 4;
+        for (int x = left; x < right; x++, pixel += 4) {
+            pixel[redOffset] = red;
+            pixel[greenOffset] = green;
+            pixel[blueOffset] = blue;
+            pixel[alphaOffset] = alpha;
+        }
+    }
+    gst_video_frame_unmap(&frame);
+}
+
+static GstBuffer* createFrame(GstVideoFormat format, int width, int height, guint8 red, guint8 green, guint8 blue, guint8 alpha)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, width, height);
+
+    GstBuffer* buffer = gst_buffer_new_allocate(0, GST_VIDEO_INFO_SIZE(&info), 0);
+    paintRect(buffer, format, width, height, 0, 0, width, height, red, green, blue, alpha);
+    return buffer;
+}
+
+static void checkFrame(GstBuffer* buffer, GstVideoInfo* info, guint8 red, guint8 green, guint8 blue, guint8 alpha)
+{
+    int redOffset = GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_R);
+    int greenOffset = GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_G);
+    int blueOffset = GST_VIDEO_INFO_COMP_POFFSET(info, GST_VIDEO_COMP_B);
+    int alphaOffset = 6 - redOffset - greenOffset - blueOffset;
+
+    GstVideoFrame frame;
+    fail_unless(gst_video_frame_map(&frame, info, buffer, GST_MAP_READ));
+    for (int y = 0; y < GST_VIDEO_FRAME_HEIGHT(&frame); y++) {
+        const guint8* pixel = (const guint8*) GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) + y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+        for (int x = 0; x < GST_VIDEO_FRAME_WIDTH(&frame); x++, pixel += 4) {
+            fail_unless_equals_int(pixel[redOffset], red);
+            fail_unless_equals_int(pixel[greenOffset], green);
+            fail_unless_equals_int(pixel[blueOffset], blue);
+            fail_unless_equals_int(pixel[alphaOffset], alpha);
+        }
+    }
+    gst_video_frame_unmap(&frame);
+}
+
+static guint8 premultiplied(guint8 component, guint8 alpha)
+{
+    return (component * alpha + 128) / 255;
+}
+
+static unsigned luma(guint8 red, guint8 green, guint8 blue)
+{
+    return (54 * red + 183 * green + 19 * blue) >> 8;
+}
+
+static GstHarness* createHarness(GstVideoFormat format, int width, int height)
+{
+    GstHarness* h = gst_harness_new("wkvsink");
+    // The harness clock only advances on request.
+    g_object_set(h->element, "sync", FALSE, NULL);
+    gst_harness_set_src_caps(h, createCaps(format, width, height));
+    return h;
+}
+
+static guint64 renderStat(GstHarness* h, const char* name)
+{
+    GstStructure* stats = 0;
+    g_object_get(h->element, "render-stats", &stats, NULL);
+    fail_unless(stats);
+
+    guint64 value = 0;
+    fail_unless(gst_structure_get_uint64(stats, name, &value));
+    gst_structure_free(stats);
+    return value;
+}
+
+static GstSample* snapshot(GstHarness* h)
+{
+    GstSample* sample = 0;
+    g_signal_emit_by_name(h->element, "snapshot", 0, 0, &sample);
+    fail_unless(sample);
+    return sample;
+}
+
+static void checkSnapshot(GstHarness* h, int width, int height, guint8 red, guint8 green, guint8 blue, guint8 alpha)
+{
+    GstSample* sample = snapshot(h);
+    GstVideoInfo info;
+    fail_unless(gst_video_info_from_caps(&info, gst_sample_get_caps(sample)));
+    fail_unless_equals_int(GST_VIDEO_INFO_WIDTH(&info), width);
+    fail_unless_equals_int(GST_VIDEO_INFO_HEIGHT(&info), height);
+    checkFrame(gst_sample_get_buffer(sample), &info, red, green, blue, alpha);
+    gst_sample_unref(sample);
+}
+
+GST_START_TEST(testAcceptCaps)
+{
+    GstHarness* h = gst_harness_new("wkvsink");
+
+    GstCaps* caps = createCaps(ALPHA_FORMAT, 64, 48);
+    fail_unless(gst_pad_peer_query_accept_caps(h->srcpad, caps));
+    gst_caps_unref(caps);
+
+    caps = createCaps(OPAQUE_FORMAT, 64, 48);
+    fail_unless(gst_pad_peer_query_accept_caps(h->srcpad, caps));
+    gst_caps_unref(caps);
+
+    caps = createCaps(GST_VIDEO_FORMAT_I420, 64, 48);
+    fail_if(gst_pad_peer_query_accept_caps(h->srcpad, caps));
+    gst_caps_unref(caps);
+
+    caps = createCaps(GST_VIDEO_FORMAT_RGB, 64, 48);
+    fail_if(gst_pad_peer_query_accept_caps(h->srcpad, caps));
+    gst_caps_unref(caps);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testCurrentCaps)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 0, 0, 0, 255)), GST_FLOW_OK);
+
+    GstCaps* caps = 0;
+    g_object_get(h->element, "current-caps", &caps, NULL);
+    GstCaps* expectedCaps = createCaps(ALPHA_FORMAT, 64, 48);
+    fail_unless(caps && gst_caps_is_equal(caps, expectedCaps));
+    gst_caps_unref(expectedCaps);
+    gst_caps_unref(caps);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testPremultiplyVideoFrame)
+{
+    static const guint8 alphas[] = { 0, 1, 127, 128, 254, 255 };
+    // Odd sizes, so the rows don't split evenly in analysis tiles.
+    const int width = 37;
+    const int height = 19;
+
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, ALPHA_FORMAT, width, height);
+
+    for (unsigned i = 0; i < G_N_ELEMENTS(alphas); i++) {
+        guint8 alpha = alphas[i];
+        guint8 red = premultiplied(200, alpha);
+        guint8 green = premultiplied(100, alpha);
+        guint8 blue = premultiplied(50, alpha);
+        unsigned expectedLuma = luma(red, green, blue);
+
+        GstBuffer* source = createFrame(ALPHA_FORMAT, width, height, 200, 100, 50, alpha);
+        GstBuffer* destination = gst_buffer_new_allocate(0, GST_VIDEO_INFO_SIZE(&info), 0);
+        GstVideoFrame sourceFrame;
+        GstVideoFrame destinationFrame;
+        fail_unless(gst_video_frame_map(&sourceFrame, &info, source, GST_MAP_READ));
+        fail_unless(gst_video_frame_map(&destinationFrame, &info, destination, GST_MAP_WRITE));
+
+        premultiplyVideoFrame(&sourceFrame, &destinationFrame, 0, 0);
+        gst_video_frame_unmap(&destinationFrame);
+        checkFrame(destination, &info, red, green, blue, alpha);
+
+        // Same result with the analysis, computed on the converted pixels.
+        FrameAnalysis analysis;
+        fail_unless(gst_video_frame_map(&destinationFrame, &info, destination, GST_MAP_WRITE));
+        premultiplyVideoFrame(&sourceFrame, &destinationFrame, 0, &analysis);
+        gst_video_frame_unmap(&destinationFrame);
+        gst_video_frame_unmap(&sourceFrame);
+        checkFrame(destination, &info, red, green, blue, alpha);
+
+        fail_unless_equals_int((int) analysis.meanLuma, expectedLuma);
+        fail_unless_equals_int(analysis.histogram[expectedLuma * FRAME_ANALYSIS_HISTOGRAM_BINS / 256], width * height);
+        fail_unless(analysis.difference == 255);
+
+        gst_buffer_unref(source);
+        gst_buffer_unref(destination);
+    }
+}
+GST_END_TEST;
+
+GST_START_TEST(testAnalyzeVideoFrame)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, OPAQUE_FORMAT, 37, 19);
+
+    GstBuffer* buffer = createFrame(OPAQUE_FORMAT, 37, 19, 10, 220, 30, 0);
+    GstVideoFrame frame;
+    fail_unless(gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ));
+    FrameAnalysis analysis;
+    analyzeVideoFrame(&frame, 0, &analysis);
+
+    // The padding byte is not alpha, nothing is premultiplied.
+    unsigned expectedLuma = luma(10, 220, 30);
+    fail_unless_equals_int((int) analysis.meanLuma, expectedLuma);
+    fail_unless_equals_int(analysis.histogram[expectedLuma * FRAME_ANALYSIS_HISTOGRAM_BINS / 256], 37 * 19);
+    fail_unless(analysis.difference == 255);
+
+    analyzeVideoFrame(&frame, &frame, &analysis);
+    fail_unless(analysis.difference == 0);
+    gst_video_frame_unmap(&frame);
+
+    gst_buffer_unref(buffer);
+}
+GST_END_TEST;
+
+GST_START_TEST(testFrameDifferenceOfSmallRegion)
+{
+    const int width = 1920;
+    const int height = 1080;
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, OPAQUE_FORMAT, width, height);
+
+    // One tile out of more than 8000 changes by 50.
+    GstBuffer* previous = createFrame(OPAQUE_FORMAT, width, height, 100, 100, 100, 0);
+    GstBuffer* current = createFrame(OPAQUE_FORMAT, width, height, 100, 100, 100, 0);
+    paintRect(current, OPAQUE_FORMAT, width, height, 160, 320, 160 + FRAME_ANALYSIS_TILE_SIZE, 320 + FRAME_ANALYSIS_TILE_SIZE, 150, 150, 150, 0);
+
+    GstVideoFrame previousFrame;
+    GstVideoFrame currentFrame;
+    fail_unless(gst_video_frame_map(&previousFrame, &info, previous, GST_MAP_READ));
+    fail_unless(gst_video_frame_map(&currentFrame, &info, current, GST_MAP_READ));
+    FrameAnalysis analysis;
+    analyzeVideoFrame(&currentFrame, &previousFrame, &analysis);
+    gst_video_frame_unmap(&currentFrame);
+    gst_video_frame_unmap(&previousFrame);
+
+    fail_unless_equals_int((int) analysis.difference, luma(150, 150, 150) - luma(100, 100, 100));
+
+    gst_buffer_unref(previous);
+    gst_buffer_unref(current);
+}
+GST_END_TEST;
+
+GST_START_TEST(testRenderPremultipliesAlphaFormat)
+{
+    static const guint8 alphas[] = { 0, 1, 128, 255 };
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+
+    for (unsigned i = 0; i < G_N_ELEMENTS(alphas); i++) {
+        guint8 alpha = alphas[i];
+        fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 200, 100, 50, alpha)), GST_FLOW_OK);
+        checkSnapshot(h, 64, 48, premultiplied(200, alpha), premultiplied(100, alpha), premultiplied(50, alpha), alpha);
+    }
+
+    fail_unless(renderStat(h, "premultiplied") >= G_N_ELEMENTS(alphas));
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testRenderKeepsOpaqueFormat)
+{
+    GstHarness* h = createHarness(OPAQUE_FORMAT, 64, 48);
+
+    fail_unless_equals_int(gst_harness_push(h, createFrame(OPAQUE_FORMAT, 64, 48, 200, 100, 50, 7)), GST_FLOW_OK);
+    checkSnapshot(h, 64, 48, 200, 100, 50, 7);
+
+    fail_unless_equals_int(renderStat(h, "premultiplied"), 0);
+    fail_unless_equals_int(renderStat(h, "allocated"), 0);
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testCapsChangeMidStream)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 200, 100, 50, 128)), GST_FLOW_OK);
+    checkSnapshot(h, 64, 48, premultiplied(200, 128), premultiplied(100, 128), premultiplied(50, 128), 128);
+
+    // Larger frames overflow the layout and the pool of the first caps.
+    gst_harness_set_src_caps(h, createCaps(ALPHA_FORMAT, 320, 240));
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 320, 240, 10, 20, 30, 64)), GST_FLOW_OK);
+    checkSnapshot(h, 320, 240, premultiplied(10, 64), premultiplied(20, 64), premultiplied(30, 64), 64);
+
+    GstCaps* caps = 0;
+    g_object_get(h->element, "current-caps", &caps, NULL);
+    GstCaps* expectedCaps = createCaps(ALPHA_FORMAT, 320, 240);
+    fail_unless(caps && gst_caps_is_equal(caps, expectedCaps));
+    gst_caps_unref(expectedCaps);
+    gst_caps_unref(caps);
+
+    // To a format that isn't premultiplied and back.
+    gst_harness_set_src_caps(h, createCaps(OPAQUE_FORMAT, 32, 16));
+    fail_unless_equals_int(gst_harness_push(h, createFrame(OPAQUE_FORMAT, 32, 16, 1, 2, 3, 4)), GST_FLOW_OK);
+    checkSnapshot(h, 32, 16, 1, 2, 3, 4);
+
+    gst_harness_set_src_caps(h, createCaps(ALPHA_FORMAT, 64, 48));
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 255, 255, 255, 255)), GST_FLOW_OK);
+    checkSnapshot(h, 64, 48, 255, 255, 255, 255);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+// Queries the pool the sink proposes for caps and checks its configuration.
+static GstBufferPool* proposedPool(GstHarness* h, GstCaps* caps, guint stridePadding)
+{
+    GstQuery* query = gst_query_new_allocation(caps, TRUE);
+    fail_unless(gst_pad_peer_query(h->srcpad, query));
+    fail_unless(gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, 0));
+    fail_unless(gst_query_get_n_allocation_pools(query) > 0);
+
+    GstBufferPool* pool = 0;
+    guint size = 0;
+    guint minBuffers = 0;
+    guint maxBuffers = 0;
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &minBuffers, &maxBuffers);
+    gst_query_unref(query);
+    fail_unless(pool);
+    fail_unless_equals_int(minBuffers, 3);
+    fail_unless_equals_int(maxBuffers, 8);
+
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    GstCaps* configCaps = 0;
+    guint configSize = 0;
+    fail_unless(gst_buffer_pool_config_get_params(config, &configCaps, &configSize, &minBuffers, &maxBuffers));
+    fail_unless(configCaps && gst_caps_is_equal(configCaps, caps));
+    fail_unless_equals_int(configSize, size);
+    fail_unless_equals_int(minBuffers, 3);
+    fail_unless_equals_int(maxBuffers, 8);
+    fail_unless(gst_buffer_pool_config_has_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META));
+    fail_unless(gst_buffer_pool_config_has_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT));
+
+    GstVideoAlignment alignment;
+    fail_unless(gst_buffer_pool_config_get_video_alignment(config, &alignment));
+    fail_unless_equals_int(alignment.padding_right, stridePadding);
+    fail_unless_equals_int(alignment.stride_align[0], 63);
+    gst_structure_free(config);
+
+    return pool;
+}
+
+// Pushes a frame of a single colour, allocated from the pool the sink
+// proposes, and returns the stride of its rows.
+static int pushPooledFrame(GstHarness* h, GstVideoFormat format, int width, int height, guint stridePadding, guint8 red, guint8 green, guint8 blue, guint8 alpha)
+{
+    GstCaps* caps = createCaps(format, width, height);
+    GstBufferPool* pool = proposedPool(h, caps, stridePadding);
+    gst_caps_unref(caps);
+    fail_unless(gst_buffer_pool_set_active(pool, TRUE));
+
+    GstBuffer* buffer = 0;
+    fail_unless_equals_int(gst_buffer_pool_acquire_buffer(pool, &buffer, 0), GST_FLOW_OK);
+    GstVideoMeta* meta = gst_buffer_get_video_meta(buffer);
+    fail_unless(meta);
+    int stride = meta->stride[0];
+
+    paintRect(buffer, format, width, height, 0, 0, width, height, red, green, blue, alpha);
+    fail_unless_equals_int(gst_harness_push(h, buffer), GST_FLOW_OK);
+
+    // The sink may still hold the buffer, it goes back to the pool later.
+    gst_buffer_pool_set_active(pool, FALSE);
+    gst_object_unref(pool);
+    return stride;
+}
+
+GST_START_TEST(testProposedPool)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 100, 48);
+    g_object_set(h->element, "stride-padding", 12, NULL);
+
+    // 112 pixels of 4 bytes, already a multiple of 64.
+    fail_unless_equals_int(pushPooledFrame(h, ALPHA_FORMAT, 100, 48, 12, 200, 100, 50, 128), 448);
+    checkSnapshot(h, 100, 48, premultiplied(200, 128), premultiplied(100, 128), premultiplied(50, 128), 128);
+
+    // The pool proposed for the new caps has the new layout, 172 pixels
+    // of 4 bytes rounded up to 704.
+    gst_harness_set_src_caps(h, createCaps(OPAQUE_FORMAT, 160, 90));
+    fail_unless_equals_int(pushPooledFrame(h, OPAQUE_FORMAT, 160, 90, 12, 1, 2, 3, 4), 704);
+    checkSnapshot(h, 160, 90, 1, 2, 3, 4);
+
+    gst_harness_set_src_caps(h, createCaps(ALPHA_FORMAT, 64, 48));
+    fail_unless_equals_int(pushPooledFrame(h, ALPHA_FORMAT, 64, 48, 12, 10, 20, 30, 64), 320);
+    checkSnapshot(h, 64, 48, premultiplied(10, 64), premultiplied(20, 64), premultiplied(30, 64), 64);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testAnalysisSkipsPrerolledBuffer)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+    g_object_set(h->element, "analyze", TRUE, "frozen-frames", 2, NULL);
+    GstBus* bus = gst_bus_new();
+    gst_element_set_bus(h->element, bus);
+
+    // The first buffer is both prerolled and rendered, that is a single
+    // frame, so two identical frames are not frozen yet.
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 200, 200, 200, 255)), GST_FLOW_OK);
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 200, 200, 200, 255)), GST_FLOW_OK);
+    fail_if(gst_bus_pop_filtered(bus, GST_MESSAGE_ELEMENT));
+
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 200, 200, 200, 255)), GST_FLOW_OK);
+    GstMessage* message = gst_bus_pop_filtered(bus, GST_MESSAGE_ELEMENT);
+    fail_unless(message);
+    const GstStructure* structure = gst_message_get_structure(message);
+    fail_unless(gst_structure_has_name(structure, "webkit-video-analysis"));
+    gboolean frozen = FALSE;
+    gboolean black = TRUE;
+    fail_unless(gst_structure_get(structure, "frozen", G_TYPE_BOOLEAN, &frozen, "black", G_TYPE_BOOLEAN, &black, NULL));
+    fail_unless(frozen);
+    fail_if(black);
+    gst_message_unref(message);
+
+    gst_element_set_bus(h->element, 0);
+    gst_object_unref(bus);
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+static GstBuffer* createFrameWithSquare(int width, int height, int left, int top)
+{
+    GstBuffer* buffer = createFrame(OPAQUE_FORMAT, width, height, 128, 128, 128, 255);
+    paintRect(buffer, OPAQUE_FORMAT, width, height, left, top, left + 32, top + 32, 200, 200, 200, 255);
+    return buffer;
+}
+
+GST_START_TEST(testAnalysisSeesSmallMotion)
+{
+    GstHarness* h = createHarness(OPAQUE_FORMAT, 1280, 720);
+    g_object_set(h->element, "analyze", TRUE, "frozen-frames", 2, NULL);
+    GstBus* bus = gst_bus_new();
+    gst_element_set_bus(h->element, bus);
+
+    // A 32x32 square moving over a static background is not frozen.
+    for (int frame = 0; frame < 6; frame++)
+        fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(1280, 720, 100 + frame * 40, 300)), GST_FLOW_OK);
+    fail_if(gst_bus_pop_filtered(bus, GST_MESSAGE_ELEMENT));
+
+    // Once it stops, it is.
+    fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(1280, 720, 300, 300)), GST_FLOW_OK);
+    fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(1280, 720, 300, 300)), GST_FLOW_OK);
+    GstMessage* message = gst_bus_pop_filtered(bus, GST_MESSAGE_ELEMENT);
+    fail_unless(message);
+    gboolean frozen = FALSE;
+    fail_unless(gst_structure_get_boolean(gst_message_get_structure(message), "frozen", &frozen));
+    fail_unless(frozen);
+    gst_message_unref(message);
+
+    gst_element_set_bus(h->element, 0);
+    gst_object_unref(bus);
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testAnalysisResetOnFlush)
+{
+    GstHarness* h = createHarness(OPAQUE_FORMAT, 64, 48);
+    g_object_set(h->element, "analyze", TRUE, "frozen-frames", 2, NULL);
+    GstBus* bus = gst_bus_new();
+    gst_element_set_bus(h->element, bus);
+
+    fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(64, 48, 0, 0)), GST_FLOW_OK);
+    fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(64, 48, 0, 0)), GST_FLOW_OK);
+
+    // The first frame after the seek is not compared with the one before.
+    fail_unless(gst_harness_push_event(h, gst_event_new_flush_start()));
+    fail_unless(gst_harness_push_event(h, gst_event_new_flush_stop(TRUE)));
+    GstSegment segment;
+    gst_segment_init(&segment, GST_FORMAT_TIME);
+    fail_unless(gst_harness_push_event(h, gst_event_new_segment(&segment)));
+
+    fail_unless_equals_int(gst_harness_push(h, createFrameWithSquare(64, 48, 0, 0)), GST_FLOW_OK);
+    fail_if(gst_bus_pop_filtered(bus, GST_MESSAGE_ELEMENT));
+
+    gst_element_set_bus(h->element, 0);
+    gst_object_unref(bus);
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+typedef struct {
+    GstHarness* harness;
+    GstFlowReturn result;
+} PushData;
+
+static gpointer pushFrame(gpointer data)
+{
+    PushData* push = data;
+    push->result = gst_harness_push(push->harness, createFrame(ALPHA_FORMAT, 64, 48, 0, 0, 0, 255));
+    return 0;
+}
+
+static void waitForStat(GstHarness* h, const char* name, guint64 value)
+{
+    while (renderStat(h, name) < value)
+        g_usleep(1000);
+}
+
+// Without a main loop nothing takes the frames, so render blocks until
+// unlock() wins the race.
+GST_START_TEST(testFlushUnblocksRender)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+
+    PushData push = { h, GST_FLOW_ERROR };
+    GThread* thread = g_thread_new("push", pushFrame, &push);
+    // Counted right before render starts waiting for the main loop.
+    waitForStat(h, "frames", 1);
+
+    fail_unless(gst_harness_push_event(h, gst_event_new_flush_start()));
+    g_thread_join(thread);
+    fail_unless(push.result == GST_FLOW_OK || push.result == GST_FLOW_FLUSHING);
+    fail_unless_equals_int(renderStat(h, "rendered"), 0);
+
+    fail_unless(gst_harness_push_event(h, gst_event_new_flush_stop(TRUE)));
+    GstSegment segment;
+    gst_segment_init(&segment, GST_FORMAT_TIME);
+    fail_unless(gst_harness_push_event(h, gst_event_new_segment(&segment)));
+
+    // Rendering resumes once something takes the frames again.
+    startMainLoop();
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 0, 0, 0, 255)), GST_FLOW_OK);
+    waitForStat(h, "rendered", 1);
+    stopMainLoop();
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testStopUnblocksRender)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+
+    PushData push = { h, GST_FLOW_ERROR };
+    GThread* thread = g_thread_new("push", pushFrame, &push);
+    // Counted right before render starts waiting for the main loop.
+    waitForStat(h, "frames", 1);
+
+    fail_unless_equals_int(gst_element_set_state(h->element, GST_STATE_NULL), GST_STATE_CHANGE_SUCCESS);
+    g_thread_join(thread);
+    fail_unless_equals_int(renderStat(h, "rendered"), 0);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+static void readRenderStats(GstElement* sink, GstBuffer* buffer, gpointer data)
+{
+    GstStructure* stats = 0;
+    g_object_get(sink, "render-stats", &stats, NULL);
+    if (!stats)
+        return;
+
+    g_atomic_int_inc((gint*) data);
+    gst_structure_free(stats);
+}
+
+// Monitoring applications sample the counters from the repaint handler,
+// which runs while the sink holds its buffer mutex.
+GST_START_TEST(testRenderStatsFromRepaintHandler)
+{
+    GstHarness* h = createHarness(ALPHA_FORMAT, 64, 48);
+    gint reads = 0;
+    g_signal_connect(h->element, "repaint-requested", G_CALLBACK(readRenderStats), &reads);
+
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 0, 0, 0, 255)), GST_FLOW_OK);
+    fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, 64, 48, 0, 0, 0, 255)), GST_FLOW_OK);
+    waitForStat(h, "rendered", 2);
+    fail_unless(g_atomic_int_get(&reads) >= 2);
+
+    gst_harness_teardown(h);
+}
+GST_END_TEST;
+
+GST_START_TEST(testHugePageAlignment)
+{
+    GstAllocator* allocator = gst_object_ref_sink(g_object_new(WEBKIT_TYPE_HUGE_PAGE_ALLOCATOR, NULL));
+    gsize hugePageSize = WEBKIT_HUGE_PAGE_ALLOCATOR(allocator)->hugePageSize;
+
+    // With or without reserved huge pages, a block starts on a huge page
+    // and all of it can be written.
+    gsize size = 2 * hugePageSize + 1;
+    GstMemory* memory = gst_allocator_alloc(allocator, size, 0);
+    fail_unless(memory);
+
+    GstMapInfo mapInfo;
+    fail_unless(gst_memory_map(memory, &mapInfo, GST_MAP_WRITE));
+    fail_unless_equals_uint64((guintptr) mapInfo.data % hugePageSize, 0);
+    fail_unless(mapInfo.size == size);
+    mapInfo.data[0] = 1;
+    mapInfo.data[size - 1] = 1;
+    gst_memory_unmap(memory, &mapInfo);
+
+    gst_memory_unref(memory);
+    gst_object_unref(allocator);
+}
+GST_END_TEST;
+
+static double renderBudgetScale(void)
+{
+    const char* value = g_getenv(RENDER_BUDGET_SCALE_VARIABLE);
+    if (!value)
+        return 1;
+
+    char* end = 0;
+    double scale = g_ascii_strtod(value, &end);
+    fail_unless(end != value && !*end && scale > 0, RENDER_BUDGET_SCALE_VARIABLE " is not a positive number: %s", value);
+    return scale;
+}
+
+GST_START_TEST(testRenderPerformance)
+{
+    // Steady state render time, premultiplication included, with a 2x
+    // margin over the cost of the premultiply loop at about 1 ns per
+    // pixel on a desktop core. The smallest size is dominated by the
+    // fixed cost of a render, rather than the pixels.
+    static const struct {
+        int width;
+        int height;
+        guint64 budget;
+    } sizes[] = {
+        { 320, 240, 300 * GST_USECOND },
+        { 1280, 720, 2 * GST_MSECOND },
+        { 1920, 1080, 4500 * GST_USECOND },
+    };
+
+    double scale = renderBudgetScale();
+    for (unsigned i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        int width = sizes[i].width;
+        int height = sizes[i].height;
+        guint64 budget = sizes[i].budget * scale;
+        GstHarness* h = createHarness(ALPHA_FORMAT, width, height);
+
+        for (int frame = 0; frame < WARM_UP_FRAMES; frame++)
+            fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, width, height, frame, 100, 50, 128)), GST_FLOW_OK);
+
+        guint64 frames = renderStat(h, "frames");
+        guint64 allocated = renderStat(h, "allocated");
+        guint64 renderTime = renderStat(h, "total-render-time");
+
+        for (int frame = 0; frame < MEASURED_FRAMES; frame++)
+            fail_unless_equals_int(gst_harness_push(h, createFrame(ALPHA_FORMAT, width, height, frame, 100, 50, 128)), GST_FLOW_OK);
+
+        frames = renderStat(h, "frames") - frames;
+        renderTime = renderStat(h, "total-render-time") - renderTime;
+        guint64 nsPerFrame = renderTime / frames;
+        g_print("%dx%d: %" G_GUINT64_FORMAT " ns/frame\n", width, height, nsPerFrame);
+
+        // Premultiplied copies are recycled once the pool is warm.
+        fail_unless_equals_uint64(renderStat(h, "allocated"), allocated);
+        fail_unless(nsPerFrame <= budget, "%dx%d renders in %" G_GUINT64_FORMAT " ns/frame, over the %" G_GUINT64_FORMAT " ns budget",
+            width, height, nsPerFrame, budget);
+
+        gst_harness_teardown(h);
+    }
+}
+GST_END_TEST;
+
+static Suite* videoSinkSuite(void)
+{
+    Suite* suite = suite_create("wkvsink");
+
+    TCase* negotiation = tcase_create("negotiation");
+    tcase_add_checked_fixture(negotiation, startMainLoop, stopMainLoop);
+    tcase_add_test(negotiation, testAcceptCaps);
+    tcase_add_test(negotiation, testCurrentCaps);
+    tcase_add_test(negotiation, testCapsChangeMidStream);
+    tcase_add_test(negotiation, testProposedPool);
+    suite_add_tcase(suite, negotiation);
+
+    TCase* conversion = tcase_create("conversion");
+    tcase_add_checked_fixture(conversion, startMainLoop, stopMainLoop);
+    tcase_add_test(conversion, testPremultiplyVideoFrame);
+    tcase_add_test(conversion, testAnalyzeVideoFrame);
+    tcase_add_test(conversion, testRenderPremultipliesAlphaFormat);
+    tcase_add_test(conversion, testRenderKeepsOpaqueFormat);
+    tcase_add_test(conversion, testFrameDifferenceOfSmallRegion);
+    tcase_add_test(conversion, testAnalysisSkipsPrerolledBuffer);
+    tcase_add_test(conversion, testAnalysisSeesSmallMotion);
+    tcase_add_test(conversion, testAnalysisResetOnFlush);
+    suite_add_tcase(suite, conversion);
+
+    // No main loop, these block render on purpose.
+    TCase* unlock = tcase_create("unlock");
+    tcase_add_test(unlock, testFlushUnblocksRender);
+    tcase_add_test(unlock, testStopUnblocksRender);
+    suite_add_tcase(suite, unlock);
+
+    TCase* stats = tcase_create("stats");
+    tcase_add_checked_fixture(stats, startMainLoop, stopMainLoop);
+    tcase_add_test(stats, testRenderStatsFromRepaintHandler);
+    suite_add_tcase(suite, stats);
+
+    TCase* allocator = tcase_create("allocator");
+    tcase_add_test(allocator, testHugePageAlignment);
+    suite_add_tcase(suite, allocator);
+
+    TCase* performance = tcase_create("performance");
+    tcase_add_checked_fixture(performance, startMainLoop, stopMainLoop);
+    tcase_set_timeout(performance, 120);
+    tcase_add_test(performance, testRenderPerformance);
+    suite_add_tcase(suite, performance);
+
+    return suite;
+}
+
+int main(int argc, char** argv)
+{
+    gst_check_init(&argc, &argv);
+    gst_element_register(0, "wkvsink", GST_RANK_NONE, WEBKIT_TYPE_VIDEO_SINK);
+
+    return gst_check_run_suite(videoSinkSuite(), "videosink", __FILE__);
+}